@@ -1,13 +1,58 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <stdexcept>
 #include <string>
 #include <optional>
 #include <cmath>
 #include <map>
+#include <array>
+#include <cstdint>
 #include <sstream>
+#include <fstream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <cctype>
+#include <new>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <random>
+#include <cstdio>
+#include <memory>
+#include <filesystem>
+#include <span>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
 #include "raylib.h"
 
-enum PieceType {
+#ifdef CHESS_EMBEDDED_ATLAS
+#include "piece_atlas.h"
+#endif
+
+// Taken during static initialization, as close to process start as we can get portably.
+const auto processStartTime = std::chrono::steady_clock::now();
+
+enum PieceType : uint8_t {
     none,
     pawn,
     knight,
@@ -16,7 +61,7 @@ enum PieceType {
     queen,
     king,
 };
-enum PieceColor {
+enum PieceColor : uint8_t {
     unknownColor,
     black,
     white
@@ -51,21 +96,11 @@ private:
     PieceType pieceType{};
 };
 
-bool isAnimating = false;
-float animationTime = 0.0f;
 float animationDuration = 0.3f;
-int animStartX = -1, animStartY = -1;
-int animEndX = -1, animEndY = -1;
-Piece animatingPiece;
-bool pendingPromotion = false;
-int promotionX = -1, promotionY = -1;
-PieceColor promotionColor = PieceColor::unknownColor;
 
 class Tile {
 public:
-    Tile(int row_, int column_) : row{ row_ }, column{ column_ }, piece{ std::nullopt }
-    {
-    }
+    Tile() = default;
 
     void setPiece(PieceType type_, PieceColor color_) {
         piece = Piece(type_, color_);
@@ -81,31 +116,111 @@ public:
     const std::optional<Piece>& getPiece() const { return piece; }
 
 private:
-    int row{};
-    int column{};
     std::optional<Piece> piece{};
 };
 
 
-class Board {
+// Fixed-size encoding of a position: 4 bits per square (piece type, high bit set for black).
+// Replaces the per-move string key. The three codes no piece uses carry the rest of the state:
+// a rook that can still castle is stored as castlingRookCode, and when black is to move the
+// black king is stored as blackKingToMoveCode.
+const uint8_t castlingRookCode = 0x7;
+const uint8_t blackKingToMoveCode = 0x8;
+
+struct PositionKey {
+    std::array<uint8_t, 32> squares{};
+
+    bool operator==(const PositionKey& other) const {
+        return squares == other.squares;
+    }
+};
+
+static_assert(sizeof(PositionKey) == 32, "PositionKey must stay a 32-byte record");
+
+// 64-bit FNV-1a over the packed bytes
+uint64_t hashPositionKey(const PositionKey& key) {
+    uint64_t hash = 14695981039346656037ull;
+    for (uint8_t byte : key.squares) {
+        hash = (hash ^ byte) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct Move {
+    int startX, startY, endX, endY;
+    PieceType type;
+    PieceColor color;
+    PieceType promotion;
+};
+
+// Long algebraic notation ("e2e4", "e7e8q"); files are mirrored, see BasicBoard::loadFen.
+std::string toCoordinateNotation(const Move& move) {
+    std::string text;
+    text += char('a' + 7 - move.startX);
+    text += char('1' + move.startY);
+    text += char('a' + 7 - move.endX);
+    text += char('1' + move.endY);
+    switch (move.promotion) {
+    case queen: text += 'q'; break;
+    case rook: text += 'r'; break;
+    case bishop: text += 'b'; break;
+    case knight: text += 'n'; break;
+    default: break;
+    }
+    return text;
+}
+
+const std::string startingPositionFen = "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+
+// Square storage policies for BasicBoard. Both expose unchecked at(x, y).
+
+// Flat row-major size x size array (the original layout).
+class GridStorage {
+public:
+    static constexpr const char* name = "grid";
+
+    explicit GridStorage(int size) : size(size), tiles(size * size) {
+    }
+
+    Tile& at(int x, int y) { return tiles[y * size + x]; }
+    size_t heapBytes() const { return tiles.capacity() * sizeof(Tile); }
+
+private:
+    int size;
+    std::vector<Tile> tiles;
+};
+
+// 10x12 mailbox with sentinel borders, stored inline so copying a board does not allocate.
+class MailboxStorage {
+public:
+    static constexpr const char* name = "mailbox";
+
+    explicit MailboxStorage(int size) {
+        if (size != 8) {
+            throw std::invalid_argument("Mailbox storage only supports 8x8 boards");
+        }
+    }
+
+    Tile& at(int x, int y) { return tiles[(y + 2) * 10 + x + 1]; }
+    size_t heapBytes() const { return 0; }
+
+private:
+    std::array<Tile, 120> tiles{};
+};
+
+template <typename Storage>
+class BasicBoard {
 public:
-    Board(const int size = 8)
-        : size(size), gameState{ GameState::whiteTurn }, lastDoubleMove{ -1, -1 },
+    BasicBoard(const int size = 8)
+        : gameState{ GameState::whiteTurn }, size(size), squares(size), lastDoubleMove{ -1, -1 },
         whiteKingMoved{ false }, blackKingMoved{ false },
         whiteRookMovedLeft{ false }, whiteRookMovedRight{ false },
         blackRookMovedLeft{ false }, blackRookMovedRight{ false },
-        halfMoveClock(0)
+        halfMoveClock(0), pendingPromotion{ false }, promotionX{ -1 }, promotionY{ -1 },
+        promotionColor{ PieceColor::unknownColor }
     {
-        for (int y = 0; y < size; ++y) {
-            std::vector<Tile> row;
-            for (int x = 0; x < size; ++x) {
-                row.emplace_back(Tile(x, y));
-            }
-            board.push_back(row);
-        }
 
-        updatePositionKey();
-        repetitionCount[positionKey]++;
+        recordPosition();
     }
 
     bool isKingInCheck(PieceColor pieceColor) {
@@ -118,7 +233,7 @@ public:
 
         for (int y = 0; y < size; ++y) {
             for (int x = 0; x < size; ++x) {
-                Tile& tile = getTile(x, y);
+                Tile& tile = tileAt(x, y);
                 if (tile.hasPiece() && tile.getPiece()->getColor() == pieceColor) {
                     for (int targetY = 0; targetY < size; ++targetY) {
                         for (int targetX = 0; targetX < size; ++targetX) {
@@ -141,7 +256,7 @@ public:
 
         for (int y = 0; y < size; ++y) {
             for (int x = 0; x < size; ++x) {
-                Tile& tile = getTile(x, y);
+                Tile& tile = tileAt(x, y);
                 if (tile.hasPiece() && tile.getPiece()->getColor() == pieceColor) {
                     for (int targetY = 0; targetY < size; ++targetY) {
                         for (int targetX = 0; targetX < size; ++targetX) {
@@ -161,6 +276,10 @@ public:
             (gameState == GameState::blackTurn && pieceColor == PieceColor::black);
     }
 
+    PieceColor getCurrentTurn() const {
+        return gameState == GameState::whiteTurn ? PieceColor::white : PieceColor::black;
+    }
+
     void switchTurn() {
         gameState = (gameState == GameState::whiteTurn) ? GameState::blackTurn : GameState::whiteTurn;
     }
@@ -169,7 +288,7 @@ public:
         if (x < 0 || x >= size || y < 0 || y >= size) {
             throw std::out_of_range("Invalid tile coordinates");
         }
-        return board[y][x];
+        return squares.at(x, y);
     }
 
     void placePiece(int x, int y, PieceType type, PieceColor color) {
@@ -186,7 +305,7 @@ public:
         int y = startY + deltaY;
 
         while (x != endX || y != endY) {
-            if (getTile(x, y).hasPiece()) {
+            if (tileAt(x, y).hasPiece()) {
                 return false;
             }
             x += deltaX;
@@ -196,11 +315,11 @@ public:
     }
 
     bool checkForObstaclesAtDestanationTile(int endX, int endY, PieceColor pieceColor) {
-        if (!getTile(endX, endY).hasPiece()) {
+        if (!tileAt(endX, endY).hasPiece()) {
             return true;
         }
         else {
-            Piece piece = getTile(endX, endY).getPiece().value();
+            Piece piece = tileAt(endX, endY).getPiece().value();
             if (piece.getColor() == pieceColor) {
                 return false;
             }
@@ -226,17 +345,65 @@ public:
     }
 
     void promotePawn(int x, int y, PieceType chosenType, PieceColor pieceColor) {
-        getTile(x, y).removePiece();
-        getTile(x, y).setPiece(chosenType, pieceColor);
+        tileAt(x, y).removePiece();
+        tileAt(x, y).setPiece(chosenType, pieceColor);
+        if (pendingPromotion && x == promotionX && y == promotionY) {
+            pendingPromotion = false;
+            // The position recorded by makeMove still had the pawn on the last rank.
+            positionHistory.pop_back();
+            recordPosition();
+        }
+    }
+
+    // All legal moves for the side to move, ordered by start square, then target square.
+    // Pawn moves to the last rank are listed once per promotion piece.
+    std::vector<Move> generateLegalMoves() {
+        std::vector<Move> moves;
+        PieceColor color = getCurrentTurn();
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                Tile& tile = tileAt(x, y);
+                if (!tile.hasPiece() || tile.getPiece()->getColor() != color) continue;
+                PieceType type = tile.getPiece()->getType();
+                for (int targetY = 0; targetY < size; ++targetY) {
+                    for (int targetX = 0; targetX < size; ++targetX) {
+                        if (!validate(x, y, targetX, targetY, color, type)) continue;
+                        if (type == PieceType::pawn && (targetY == 0 || targetY == size - 1)) {
+                            for (PieceType promotion : { queen, rook, bishop, knight }) {
+                                moves.push_back({ x, y, targetX, targetY, type, color, promotion });
+                            }
+                        }
+                        else {
+                            moves.push_back({ x, y, targetX, targetY, type, color, PieceType::none });
+                        }
+                    }
+                }
+            }
+        }
+        return moves;
     }
 
+    // makeMove followed by the promotion choice, for callers without a promotion UI.
+    void applyMove(const Move& move) {
+        makeMove(move.startX, move.startY, move.endX, move.endY, move.color, move.type);
+        if (pendingPromotion) {
+            promotePawn(promotionX, promotionY, move.promotion == PieceType::none ? queen : move.promotion, move.color);
+        }
+    }
+
+    bool isPromotionPending() const { return pendingPromotion; }
+    int getPromotionX() const { return promotionX; }
+    int getPromotionY() const { return promotionY; }
+    PieceColor getPromotionColor() const { return promotionColor; }
+
     bool isCastlingValid(int startX, int startY, int endX, int endY, PieceColor pieceColor) {
 
         if (abs(endX - startX) != 2 || startY != endY) return false;
         int rookX = (endX > startX) ? 7 : 0;
-        Tile& rookTile = getTile(rookX, startY);
+        Tile& rookTile = tileAt(rookX, startY);
 
-        if (!rookTile.hasPiece() || rookTile.getPiece()->getType() != PieceType::rook) return false;
+        if (!rookTile.hasPiece() || rookTile.getPiece()->getType() != PieceType::rook ||
+            rookTile.getPiece()->getColor() != pieceColor) return false;
 
         if (pieceColor == white) {
             if (whiteKingMoved || (rookX == 0 && whiteRookMovedLeft) || (rookX == 7 && whiteRookMovedRight)) {
@@ -251,6 +418,12 @@ public:
 
         if (!isPathClear(startX, startY, rookX, startY)) return false;
 
+        // No castling out of or through check; validate() rejects landing in check.
+        int step = (endX > startX) ? 1 : -1;
+        if (isTileUnderAttack(startX, startY, pieceColor) || isTileUnderAttack(startX + step, startY, pieceColor)) {
+            return false;
+        }
+
         return true;
     }
 
@@ -270,8 +443,8 @@ public:
             return false;
         }
 
-        if (getTile(endX, endY).hasPiece() &&
-            getTile(endX, endY).getPiece()->getColor() == pieceColor) {
+        if (tileAt(endX, endY).hasPiece() &&
+            tileAt(endX, endY).getPiece()->getColor() == pieceColor) {
             return false;
         }
 
@@ -283,22 +456,18 @@ public:
             if (isEnPassantValid(startX, startY, endX, endY, pieceColor)) return true;
 
             if (pieceColor == PieceColor::white) {
-                if (startY == 1 && endY - startY == 2 && deltaX == 0 && isPathClear(startX, startY, endX, endY)) {
-                    lastDoubleMove = { endX, endY };
-                    return true;
-                }
-                if (endY - startY == 1 && deltaX == 0 && !getTile(endX, endY).hasPiece()) return true;
-                if (endY - startY == 1 && deltaX == 1 && getTile(endX, endY).hasPiece() &&
-                    getTile(endX, endY).getPiece()->getColor() == PieceColor::black) return true;
+                if (startY == 1 && endY - startY == 2 && deltaX == 0 && isPathClear(startX, startY, endX, endY) &&
+                    !tileAt(endX, endY).hasPiece()) return true;
+                if (endY - startY == 1 && deltaX == 0 && !tileAt(endX, endY).hasPiece()) return true;
+                if (endY - startY == 1 && deltaX == 1 && tileAt(endX, endY).hasPiece() &&
+                    tileAt(endX, endY).getPiece()->getColor() == PieceColor::black) return true;
             }
             else if (pieceColor == PieceColor::black) {
-                if (startY == 6 && startY - endY == 2 && deltaX == 0 && isPathClear(startX, startY, endX, endY)) {
-                    lastDoubleMove = { endX, endY };
-                    return true;
-                }
-                if (startY - endY == 1 && deltaX == 0 && !getTile(endX, endY).hasPiece()) return true;
-                if (startY - endY == 1 && deltaX == 1 && getTile(endX, endY).hasPiece() &&
-                    getTile(endX, endY).getPiece()->getColor() == PieceColor::white) return true;
+                if (startY == 6 && startY - endY == 2 && deltaX == 0 && isPathClear(startX, startY, endX, endY) &&
+                    !tileAt(endX, endY).hasPiece()) return true;
+                if (startY - endY == 1 && deltaX == 0 && !tileAt(endX, endY).hasPiece()) return true;
+                if (startY - endY == 1 && deltaX == 1 && tileAt(endX, endY).hasPiece() &&
+                    tileAt(endX, endY).getPiece()->getColor() == PieceColor::white) return true;
             }
             return false;
 
@@ -325,16 +494,25 @@ public:
 
     void makeMove(int startX, int startY, int endX, int endY, PieceColor pieceColor, PieceType pieceType) {
         bool isPawnMoveOrCapture = false;
-        if (isCastlingValid(startX, startY, endX, endY, pieceColor)) {
+        bool isCastling = pieceType == PieceType::king && isCastlingValid(startX, startY, endX, endY, pieceColor);
+        bool isEnPassant = pieceType == PieceType::pawn && isEnPassantValid(startX, startY, endX, endY, pieceColor);
+
+        // En passant is only available on the reply to a double step.
+        lastDoubleMove = { -1, -1 };
+        if (pieceType == PieceType::pawn && abs(endY - startY) == 2) {
+            lastDoubleMove = { endX, endY };
+        }
+
+        if (isCastling) {
 
             int rookStartX = (endX > startX) ? 7 : 0;
             int rookEndX = (endX > startX) ? endX - 1 : endX + 1;
 
-            getTile(rookEndX, startY).setPiece(PieceType::rook, pieceColor);
-            getTile(rookStartX, startY).removePiece();
+            tileAt(rookEndX, startY).setPiece(PieceType::rook, pieceColor);
+            tileAt(rookStartX, startY).removePiece();
 
-            getTile(endX, endY).setPiece(pieceType, pieceColor);
-            getTile(startX, startY).removePiece();
+            tileAt(endX, endY).setPiece(pieceType, pieceColor);
+            tileAt(startX, startY).removePiece();
 
             if (pieceColor == PieceColor::white) {
                 whiteKingMoved = true;
@@ -349,27 +527,26 @@ public:
 
             switchTurn();
             updateHalfMoveClock(isPawnMoveOrCapture);
-            updatePositionKey();                      
-            repetitionCount[positionKey]++;           
+            recordPosition();
             return;
         }
 
-        if (isEnPassantValid(startX, startY, endX, endY, pieceColor)) {
+        if (isEnPassant) {
             int capturedPawnY = (pieceColor == PieceColor::white) ? endY - 1 : endY + 1;
-            getTile(endX, capturedPawnY).removePiece();
+            tileAt(endX, capturedPawnY).removePiece();
             isPawnMoveOrCapture = true;
         }
 
-        if (getTile(startX, startY).getPiece()->getType() == PieceType::pawn) {
+        if (tileAt(startX, startY).getPiece()->getType() == PieceType::pawn) {
             isPawnMoveOrCapture = true;
         }
 
-        if (getTile(endX, endY).hasPiece()) {
+        if (tileAt(endX, endY).hasPiece()) {
             isPawnMoveOrCapture = true;
         }
 
-        getTile(endX, endY).setPiece(pieceType, pieceColor);
-        getTile(startX, startY).removePiece();
+        tileAt(endX, endY).setPiece(pieceType, pieceColor);
+        tileAt(startX, startY).removePiece();
 
         if (pieceType == PieceType::pawn && (endY == 0 || endY == 7)) {
             // Defer promotion choice
@@ -398,28 +575,110 @@ public:
 
         switchTurn();
         updateHalfMoveClock(isPawnMoveOrCapture);
-        updatePositionKey();                     
-        repetitionCount[positionKey]++;          
+        recordPosition();
     }
 
     int getSize() const { return size; }
 
+    // Bytes held by this board, inline and on the heap.
+    size_t memoryUsage() const {
+        return sizeof(*this) + squares.heapBytes() + positionHistory.capacity() * sizeof(uint64_t);
+    }
+
+    // Sets up the board from a FEN string. Files are mirrored (a-file is x = 7) and
+    // rank 1 is y = 0, matching the layout used by main().
+    void loadFen(const std::string& fen) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                tileAt(x, y).removePiece();
+            }
+        }
+
+        std::istringstream fields(fen);
+        std::string placement, side, castling, enPassant;
+        fields >> placement >> side >> castling >> enPassant >> halfMoveClock;
+        if (!fields) halfMoveClock = 0;
+
+        int x = size - 1;
+        int y = size - 1;
+        for (char c : placement) {
+            if (c == '/') {
+                x = size - 1;
+                --y;
+            }
+            else if (c >= '1' && c <= '8') {
+                x -= c - '0';
+            }
+            else {
+                PieceType type = PieceType::none;
+                switch (tolower(c)) {
+                case 'p': type = pawn; break;
+                case 'n': type = knight; break;
+                case 'b': type = bishop; break;
+                case 'r': type = rook; break;
+                case 'q': type = queen; break;
+                case 'k': type = king; break;
+                default: throw std::invalid_argument("Invalid FEN piece: " + fen);
+                }
+                placePiece(x, y, type, isupper(c) ? PieceColor::white : PieceColor::black);
+                --x;
+            }
+        }
+
+        gameState = (side == "b") ? GameState::blackTurn : GameState::whiteTurn;
+
+        whiteRookMovedLeft = castling.find('K') == std::string::npos;
+        whiteRookMovedRight = castling.find('Q') == std::string::npos;
+        blackRookMovedLeft = castling.find('k') == std::string::npos;
+        blackRookMovedRight = castling.find('q') == std::string::npos;
+        whiteKingMoved = whiteRookMovedLeft && whiteRookMovedRight;
+        blackKingMoved = blackRookMovedLeft && blackRookMovedRight;
+
+        lastDoubleMove = { -1, -1 };
+        if (enPassant.size() == 2) {
+            lastDoubleMove = { size - 1 - (enPassant[0] - 'a'), enPassant[1] == '3' ? 3 : 4 };
+        }
+
+        pendingPromotion = false;
+        positionHistory.clear();
+        recordPosition();
+    }
+
    
     bool isThreefoldRepetition() const {
-        for (auto& entry : repetitionCount) {
-            if (entry.second >= 3) return true;
-        }
-        return false;
+        return std::count(positionHistory.begin(), positionHistory.end(), positionHistory.back()) >= 3;
     }
 
     bool isFiftyMoveRuleDraw() const {
         return halfMoveClock >= 100;
     }
 
+    PositionKey generatePositionKey() {
+        PositionKey key;
+        // Board pieces, two squares per byte
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                uint8_t code = 0;
+                if (tileAt(x, y).hasPiece()) {
+                    const Piece& p = *tileAt(x, y).getPiece();
+                    code = static_cast<uint8_t>(p.getType());
+                    if (p.getType() == rook && isCastlingRook(x, y, p.getColor())) code = castlingRookCode;
+                    if (p.getColor() == black) code |= 0x8;
+                    if (p.getType() == king && p.getColor() == black && gameState == blackTurn) code = blackKingToMoveCode;
+                }
+                int index = y * size + x;
+                key.squares[index / 2] |= (index % 2 == 0) ? code : static_cast<uint8_t>(code << 4);
+            }
+        }
+        return key;
+    }
+
+    uint64_t getPositionHash() const { return positionHistory.back(); }
+
 private:
     GameState gameState;
-    const int size;
-    std::vector<std::vector<Tile>> board;
+    int size;
+    Storage squares;
     std::pair<int, int> lastDoubleMove;
     bool whiteKingMoved;
     bool blackKingMoved;
@@ -429,13 +688,21 @@ private:
     bool blackRookMovedRight;
 
     int halfMoveClock;
-    std::map<std::string, int> repetitionCount;
-    std::string positionKey;
+    // Hashes of the positions since the last pawn move or capture; earlier positions can never repeat.
+    std::vector<uint64_t> positionHistory;
+
+    bool pendingPromotion;
+    int promotionX;
+    int promotionY;
+    PieceColor promotionColor;
+
+    // Unchecked access for the rule code; coordinates are validated by the callers.
+    Tile& tileAt(int x, int y) { return squares.at(x, y); }
 
     std::pair<int, int> findKing(PieceColor pieceColor) {
         for (int y = 0; y < size; ++y) {
             for (int x = 0; x < size; ++x) {
-                Tile& tile = getTile(x, y);
+                Tile& tile = tileAt(x, y);
                 if (tile.hasPiece() && tile.getPiece()->getType() == PieceType::king &&
                     tile.getPiece()->getColor() == pieceColor) {
                     return { x, y };
@@ -450,9 +717,14 @@ private:
 
         for (int row = 0; row < size; ++row) {
             for (int col = 0; col < size; ++col) {
-                Tile& tile = getTile(col, row);
-                if (tile.hasPiece() && tile.getPiece()->getColor() == attackerColor &&
-                    isMoveValid(col, row, x, y, attackerColor, tile.getPiece()->getType())) {
+                Tile& tile = tileAt(col, row);
+                if (!tile.hasPiece() || tile.getPiece()->getColor() != attackerColor) continue;
+                // A king only attacks adjacent squares; castling never captures.
+                if (tile.getPiece()->getType() == PieceType::king) {
+                    if (abs(col - x) <= 1 && abs(row - y) <= 1) return true;
+                    continue;
+                }
+                if (isMoveValid(col, row, x, y, attackerColor, tile.getPiece()->getType())) {
                     return true;
                 }
             }
@@ -462,107 +734,202 @@ private:
 
     Piece simulateMove(int startX, int startY, int endX, int endY) {
         Piece capturedPiece = Piece();
-        if (getTile(endX, endY).hasPiece()) {
-            capturedPiece = *getTile(endX, endY).getPiece();
+        if (tileAt(endX, endY).hasPiece()) {
+            capturedPiece = *tileAt(endX, endY).getPiece();
         }
 
-        getTile(endX, endY).setPiece(getTile(startX, startY).getPiece()->getType(),
-            getTile(startX, startY).getPiece()->getColor());
-        getTile(startX, startY).removePiece();
+        tileAt(endX, endY).setPiece(tileAt(startX, startY).getPiece()->getType(),
+            tileAt(startX, startY).getPiece()->getColor());
+        tileAt(startX, startY).removePiece();
 
         return capturedPiece;
     }
 
     void undoMove(int startX, int startY, int endX, int endY, Piece capturedPiece) {
-        getTile(startX, startY).setPiece(getTile(endX, endY).getPiece()->getType(),
-            getTile(endX, endY).getPiece()->getColor());
-        getTile(endX, endY).removePiece();
+        tileAt(startX, startY).setPiece(tileAt(endX, endY).getPiece()->getType(),
+            tileAt(endX, endY).getPiece()->getColor());
+        tileAt(endX, endY).removePiece();
 
         if (capturedPiece.getType() != PieceType::none) {
-            getTile(endX, endY).setPiece(capturedPiece.getType(), capturedPiece.getColor());
+            tileAt(endX, endY).setPiece(capturedPiece.getType(), capturedPiece.getColor());
         }
     }
 
     void updateHalfMoveClock(bool isPawnMoveOrCapture) {
         if (isPawnMoveOrCapture) {
             halfMoveClock = 0;
+            positionHistory.clear();
         }
         else {
             halfMoveClock++;
         }
     }
 
-    std::string generatePositionKey() {
-        std::ostringstream oss;
-        // Board pieces
-        for (int y = 0; y < size; ++y) {
-            for (int x = 0; x < size; ++x) {
-                if (getTile(x, y).hasPiece()) {
-                    const Piece& p = *getTile(x, y).getPiece();
-                    char c = ' ';
-                    switch (p.getType()) {
-                    case pawn: c = 'P'; break;
-                    case knight: c = 'N'; break;
-                    case bishop: c = 'B'; break;
-                    case rook: c = 'R'; break;
-                    case queen: c = 'Q'; break;
-                    case king: c = 'K'; break;
-                    default: c = '.'; break;
-                    }
-                    if (p.getColor() == black) c = tolower(c);
-                    oss << c;
-                }
-                else {
-                    oss << '.';
-                }
-            }
+    // A rook on its home corner whose side may still castle with it.
+    bool isCastlingRook(int x, int y, PieceColor color) const {
+        if (color == white && y == 0) {
+            return !whiteKingMoved && ((x == 0 && !whiteRookMovedLeft) || (x == 7 && !whiteRookMovedRight));
+        }
+        if (color == black && y == 7) {
+            return !blackKingMoved && ((x == 0 && !blackRookMovedLeft) || (x == 7 && !blackRookMovedRight));
         }
-        
-        oss << ((gameState == whiteTurn) ? 'w' : 'b');
+        return false;
+    }
+
+    void recordPosition() {
+        positionHistory.push_back(hashPositionKey(generatePositionKey()));
+    }
+};
+
+using Board = BasicBoard<GridStorage>;
+using MailboxBoard = BasicBoard<MailboxStorage>;
+
+const std::vector<std::string> pieceTextureKeys = {
+    "pawn_white", "knight_white", "bishop_white", "rook_white", "queen_white", "king_white",
+    "pawn_black", "knight_black", "bishop_black", "rook_black", "queen_black", "king_black",
+};
+const int atlasColumns = 6;
 
-        if (!whiteKingMoved && !whiteRookMovedLeft) oss << 'Q';
-        if (!whiteKingMoved && !whiteRookMovedRight) oss << 'K';
-        if (!blackKingMoved && !blackRookMovedLeft) oss << 'q';
-        if (!blackKingMoved && !blackRookMovedRight) oss << 'k';
+// All piece images live in one texture; pieceTextures maps a key to its cell.
+Texture2D pieceAtlas{};
+std::map<std::string, Rectangle> pieceTextures;
 
-        return oss.str();
+std::string resolveAssetPath(const std::string& fileName) {
+    std::string besideExecutable = std::string(GetApplicationDirectory()) + "images/" + fileName;
+    if (FileExists(besideExecutable.c_str())) return besideExecutable;
+    return "images/" + fileName;
+}
+
+// Decodes the piece PNGs on worker threads and packs them into a single CPU-side atlas.
+Image buildPieceAtlasImage() {
+    std::vector<std::future<Image>> decoding;
+    for (const std::string& key : pieceTextureKeys) {
+        std::string path = resolveAssetPath(key + ".png");
+        decoding.push_back(std::async(std::launch::async, [path]() { return LoadImage(path.c_str()); }));
     }
 
-    void updatePositionKey() {
-        positionKey = generatePositionKey();
+    std::vector<Image> images;
+    int cellWidth = 0, cellHeight = 0;
+    for (auto& pending : decoding) {
+        images.push_back(pending.get());
+        cellWidth = std::max(cellWidth, images.back().width);
+        cellHeight = std::max(cellHeight, images.back().height);
     }
-};
 
-std::map<std::string, Texture2D> pieceTextures;
+    int rows = ((int)images.size() + atlasColumns - 1) / atlasColumns;
+    Image atlas = GenImageColor(cellWidth * atlasColumns, cellHeight * rows, BLANK);
+    for (int i = 0; i < (int)images.size(); ++i) {
+        if (images[i].data == nullptr) continue;
+        Rectangle source = { 0, 0, (float)images[i].width, (float)images[i].height };
+        Rectangle dest = { (float)(i % atlasColumns * cellWidth), (float)(i / atlasColumns * cellHeight),
+            (float)images[i].width, (float)images[i].height };
+        ImageDraw(&atlas, images[i], source, dest, WHITE);
+        UnloadImage(images[i]);
+    }
+    return atlas;
+}
+
+// The caller owns the returned image and must UnloadImage it.
+Image loadPieceAtlasImage() {
+#ifdef CHESS_EMBEDDED_ATLAS
+    // Generated with --export-atlas piece_atlas.h; raw pixels, no file I/O or decoding.
+    Image embedded = { PIECE_ATLAS_DATA, PIECE_ATLAS_WIDTH, PIECE_ATLAS_HEIGHT, 1, PIECE_ATLAS_FORMAT };
+    return ImageCopy(embedded);
+#else
+    return buildPieceAtlasImage();
+#endif
+}
+
+// Cell of pieceTextureKeys[index] in an atlas of the given size.
+Rectangle atlasCell(int index, int atlasWidth, int atlasHeight) {
+    int rows = ((int)pieceTextureKeys.size() + atlasColumns - 1) / atlasColumns;
+    float cellWidth = (float)atlasWidth / atlasColumns;
+    float cellHeight = (float)atlasHeight / rows;
+    return { index % atlasColumns * cellWidth, index / atlasColumns * cellHeight, cellWidth, cellHeight };
+}
+
+int atlasIndex(const Piece& piece) {
+    return (piece.getType() - PieceType::pawn) + (piece.getColor() == PieceColor::black ? atlasColumns : 0);
+}
 
 void loadTextures() {
-    pieceTextures["pawn_white"] = LoadTexture("images/pawn_white.png");
-    pieceTextures["pawn_black"] = LoadTexture("images/pawn_black.png");
-    pieceTextures["knight_white"] = LoadTexture("images/knight_white.png");
-    pieceTextures["knight_black"] = LoadTexture("images/knight_black.png");
-    pieceTextures["rook_white"] = LoadTexture("images/rook_white.png");
-    pieceTextures["rook_black"] = LoadTexture("images/rook_black.png");
-    pieceTextures["bishop_white"] = LoadTexture("images/bishop_white.png");
-    pieceTextures["bishop_black"] = LoadTexture("images/bishop_black.png");
-    pieceTextures["queen_white"] = LoadTexture("images/queen_white.png");
-    pieceTextures["queen_black"] = LoadTexture("images/queen_black.png");
-    pieceTextures["king_white"] = LoadTexture("images/king_white.png");
-    pieceTextures["king_black"] = LoadTexture("images/king_black.png");
+    Image atlas = loadPieceAtlasImage();
+    pieceAtlas = LoadTextureFromImage(atlas);
+    UnloadImage(atlas);
+
+    for (int i = 0; i < (int)pieceTextureKeys.size(); ++i) {
+        pieceTextures[pieceTextureKeys[i]] = atlasCell(i, pieceAtlas.width, pieceAtlas.height);
+    }
 }
 
 void unloadTextures() {
-    for (auto& [key, texture] : pieceTextures) {
-        UnloadTexture(texture);
+    UnloadTexture(pieceAtlas);
+    pieceTextures.clear();
+}
+
+void drawPieceTexture(const std::string& key, int x, int y) {
+    auto it = pieceTextures.find(key);
+    if (it != pieceTextures.end()) {
+        DrawTextureRec(pieceAtlas, it->second, { (float)x, (float)y }, WHITE);
+    }
+}
+
+// Moves are committed to the Board as soon as they are made; these only slide the
+// piece across on screen. Several can run at once (e.g. a move and the premove it triggers).
+struct MoveAnimation {
+    Piece piece;
+    int startX, startY, endX, endY;
+    float time;
+
+    bool isCastling() const {
+        return piece.getType() == PieceType::king && abs(endX - startX) == 2;
+    }
+    int rookStartX() const { return (endX > startX) ? 7 : 0; }
+    int rookEndX() const { return (endX > startX) ? endX - 1 : endX + 1; }
+};
+
+std::vector<MoveAnimation> activeAnimations;
+
+// A move queued for the side not on turn, tried as soon as the other side's move lands.
+std::optional<Move> premove;
+
+void updateAnimation(float deltaTime) {
+    for (MoveAnimation& animation : activeAnimations) {
+        animation.time += deltaTime;
     }
+    activeAnimations.erase(std::remove_if(activeAnimations.begin(), activeAnimations.end(),
+        [](const MoveAnimation& animation) { return animation.time >= animationDuration; }), activeAnimations.end());
 }
 
-void updateAnimation(Board& board, float deltaTime) {
-    if (!isAnimating) return;
+// True when the piece on this square is still being drawn in flight.
+bool isAnimationTarget(int x, int y) {
+    for (const MoveAnimation& animation : activeAnimations) {
+        if (animation.endX == x && animation.endY == y) return true;
+        if (animation.isCastling() && animation.rookEndX() == x && animation.endY == y) return true;
+    }
+    return false;
+}
+
+void applyPremove(Board& board);
+
+// Applies the move to the board immediately and starts its animation.
+void commitMove(Board& board, int startX, int startY, int endX, int endY) {
+    Piece piece = *board.getTile(startX, startY).getPiece();
+    activeAnimations.push_back({ piece, startX, startY, endX, endY, 0.0f });
+    board.makeMove(startX, startY, endX, endY, piece.getColor(), piece.getType());
+    applyPremove(board);
+}
+
+void applyPremove(Board& board) {
+    if (!premove || board.isPromotionPending()) return;
+    Move move = *premove;
+    premove.reset();
 
-    animationTime += deltaTime;
-    if (animationTime >= animationDuration) {
-        isAnimating = false;
-        board.makeMove(animStartX, animStartY, animEndX, animEndY, animatingPiece.getColor(), animatingPiece.getType());
+    const Tile& tile = board.getTile(move.startX, move.startY);
+    if (move.color == board.getCurrentTurn() && tile.hasPiece() &&
+        tile.getPiece()->getColor() == move.color && tile.getPiece()->getType() == move.type &&
+        board.validate(move.startX, move.startY, move.endX, move.endY, move.color, move.type)) {
+        commitMove(board, move.startX, move.startY, move.endX, move.endY);
     }
 }
 
@@ -570,6 +937,50 @@ float Lerp(float start, float end, float t) {
     return start + t * (end - start);
 }
 
+// Everything the game reads from raylib in one frame, so sessions can be recorded and replayed.
+struct FrameInput {
+    float deltaTime;
+    bool clicked;
+    int mouseX;
+    int mouseY;
+};
+
+FrameInput pollFrameInput() {
+    return { GetFrameTime(), IsMouseButtonPressed(MOUSE_LEFT_BUTTON), GetMouseX(), GetMouseY() };
+}
+
+// Session files hold one line per frame: "deltaTime clicked mouseX mouseY".
+void writeFrameInput(std::ostream& out, const FrameInput& input) {
+    out << input.deltaTime << ' ' << input.clicked << ' ' << input.mouseX << ' ' << input.mouseY << '\n';
+}
+
+std::vector<FrameInput> loadInputRecording(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open recording: " + path);
+    }
+    std::vector<FrameInput> frames;
+    FrameInput input{};
+    while (in >> input.deltaTime >> input.clicked >> input.mouseX >> input.mouseY) {
+        frames.push_back(input);
+    }
+    return frames;
+}
+
+// When set, frames are drawn into offscreenTarget instead of the window (replay benchmarks).
+bool renderOffscreen = false;
+RenderTexture2D offscreenTarget{};
+
+void beginFrame() {
+    if (renderOffscreen) BeginTextureMode(offscreenTarget);
+    else BeginDrawing();
+}
+
+void endFrame() {
+    if (renderOffscreen) EndTextureMode();
+    else EndDrawing();
+}
+
 void drawPromotionUI(PieceColor color) {
   
     int panelX = 200;
@@ -591,12 +1002,11 @@ void drawPromotionUI(PieceColor color) {
     int spacing = 50;
 
     for (int i = 0; i < (int)options.size(); i++) {
-        Texture2D tex = pieceTextures[options[i].second];
-        DrawTexture(tex, startX + i * spacing, startY, WHITE);
+        drawPieceTexture(options[i].second, startX + i * spacing, startY);
     }
 }
 
-PieceType handlePromotionInput(PieceColor color) {
+PieceType handlePromotionInput(PieceColor color, const FrameInput& input) {
  
     int panelX = 200;
     int panelY = 200;
@@ -616,8 +1026,8 @@ PieceType handlePromotionInput(PieceColor color) {
         {knight, {(float)startX + 3 * spacing, (float)startY, 40.0f, 40.0f}}
     };
 
-    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-        Vector2 mousePos = GetMousePosition();
+    if (input.clicked) {
+        Vector2 mousePos = { (float)input.mouseX, (float)input.mouseY };
         for (auto& ch : choices) {
             if (CheckCollisionPointRec(mousePos, ch.rect)) {
                 return ch.type;
@@ -658,9 +1068,12 @@ void drawBoard(Board& board, const std::vector<std::pair<int, int>>& validMoves,
             else if (std::find(validMoves.begin(), validMoves.end(), std::make_pair(col, row)) != validMoves.end()) {
                 DrawRectangle(margin + col * tileSize, margin + row * tileSize, tileSize, tileSize, YELLOW);
             }
+            else if (premove && ((premove->startX == col && premove->startY == row) || (premove->endX == col && premove->endY == row))) {
+                DrawRectangle(margin + col * tileSize, margin + row * tileSize, tileSize, tileSize, SKYBLUE);
+            }
 
             Tile& tile = board.getTile(col, row);
-            if (tile.hasPiece() && (!isAnimating || animStartX != col || animStartY != row)) {
+            if (tile.hasPiece() && !isAnimationTarget(col, row)) {
                 const Piece& piece = *tile.getPiece();
                 std::string textureKey;
 
@@ -675,17 +1088,17 @@ void drawBoard(Board& board, const std::vector<std::pair<int, int>>& validMoves,
                 }
 
                 if (!textureKey.empty()) {
-                    Texture2D texture = pieceTextures[textureKey];
-                    DrawTexture(texture, margin + col * tileSize, margin + row * tileSize, WHITE);
+                    drawPieceTexture(textureKey, margin + col * tileSize, margin + row * tileSize);
                 }
             }
         }
     }
 
-    if (isAnimating) {
-        float t = animationTime / animationDuration;
-        float animX = Lerp(animStartX * tileSize, animEndX * tileSize, t);
-        float animY = Lerp(animStartY * tileSize, animEndY * tileSize, t);
+    for (const MoveAnimation& animation : activeAnimations) {
+        const Piece& animatingPiece = animation.piece;
+        float t = animation.time / animationDuration;
+        float animX = Lerp(animation.startX * tileSize, animation.endX * tileSize, t);
+        float animY = Lerp(animation.startY * tileSize, animation.endY * tileSize, t);
 
         std::string textureKey;
         switch (animatingPiece.getType()) {
@@ -699,72 +1112,111 @@ void drawBoard(Board& board, const std::vector<std::pair<int, int>>& validMoves,
         }
 
         if (!textureKey.empty()) {
-            Texture2D texture = pieceTextures[textureKey];
-            DrawTexture(texture, margin + (int)animX, margin + (int)animY, WHITE);
+            drawPieceTexture(textureKey, margin + (int)animX, margin + (int)animY);
         }
 
-        if (animatingPiece.getType() == PieceType::king && abs(animEndX - animStartX) == 2) {
-            int rookStartX = (animEndX > animStartX) ? 7 : 0;
-            int rookEndX = (animEndX > animStartX) ? animEndX - 1 : animEndX + 1;
-
-            float rookAnimX = Lerp(rookStartX * tileSize, rookEndX * tileSize, t);
-            float rookAnimY = animStartY * tileSize;
+        if (animation.isCastling()) {
+            float rookAnimX = Lerp(animation.rookStartX() * tileSize, animation.rookEndX() * tileSize, t);
+            float rookAnimY = animation.startY * tileSize;
 
             std::string rookTextureKey = animatingPiece.getColor() == PieceColor::white ? "rook_white" : "rook_black";
-            Texture2D rookTexture = pieceTextures[rookTextureKey];
-            DrawTexture(rookTexture, margin + (int)rookAnimX, margin + (int)rookAnimY, WHITE);
+            drawPieceTexture(rookTextureKey, margin + (int)rookAnimX, margin + (int)rookAnimY);
+        }
+    }
+}
+
+
+template <typename BoardType>
+void computeValidMoves(BoardType& board, int selectedX, int selectedY, std::vector<std::pair<int, int>>& validMoves) {
+    validMoves.clear();
+    Piece piece = *board.getTile(selectedX, selectedY).getPiece();
+    for (int y = 0; y < board.getSize(); ++y) {
+        for (int x = 0; x < board.getSize(); ++x) {
+            if (board.validate(selectedX, selectedY, x, y, piece.getColor(), piece.getType())) {
+                validMoves.emplace_back(x, y);
+            }
         }
     }
 }
 
+// Squares the piece could reach on an open board, ignoring blockers, captures and check,
+// since the position will have changed by the time a premove is played. applyPremove
+// does the real validation.
+void computePremoveTargets(Board& board, int selectedX, int selectedY, std::vector<std::pair<int, int>>& targets) {
+    targets.clear();
+    Piece piece = *board.getTile(selectedX, selectedY).getPiece();
+    int forward = piece.getColor() == PieceColor::white ? 1 : -1;
+    int homeRank = piece.getColor() == PieceColor::white ? 0 : board.getSize() - 1;
+    for (int y = 0; y < board.getSize(); ++y) {
+        for (int x = 0; x < board.getSize(); ++x) {
+            int dx = x - selectedX;
+            int dy = y - selectedY;
+            if (dx == 0 && dy == 0) continue;
+            bool reachable = false;
+            switch (piece.getType()) {
+            case pawn:
+                reachable = (dy == forward && abs(dx) <= 1) ||
+                    (dx == 0 && dy == 2 * forward && selectedY == homeRank + forward);
+                break;
+            case knight: reachable = abs(dx) * abs(dy) == 2; break;
+            case bishop: reachable = abs(dx) == abs(dy); break;
+            case rook: reachable = dx == 0 || dy == 0; break;
+            case queen: reachable = dx == 0 || dy == 0 || abs(dx) == abs(dy); break;
+            case king:
+                reachable = (abs(dx) <= 1 && abs(dy) <= 1) ||
+                    (dy == 0 && abs(dx) == 2 && selectedX == 3 && selectedY == homeRank);
+                break;
+            default: break;
+            }
+            if (reachable) targets.emplace_back(x, y);
+        }
+    }
+}
 
-void handlePlayerInput(Board& board, PieceColor currentTurn,
+void handlePlayerInput(Board& board, PieceColor currentTurn, const FrameInput& input,
     std::vector<std::pair<int, int>>& validMoves,
     int& selectedX, int& selectedY, bool& pieceSelected) {
 
-    if (pendingPromotion) return;
+    if (board.isPromotionPending()) return;
 
-    if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
+    if (input.clicked) {
         int tileSize = 80;
         int margin = 20;
-        int tileX = (GetMouseX() - margin) / tileSize;
-        int tileY = (GetMouseY() - margin) / tileSize;
+        int tileX = (input.mouseX - margin) / tileSize;
+        int tileY = (input.mouseY - margin) / tileSize;
 
         if (tileX < 0 || tileX >= board.getSize() || tileY < 0 || tileY >= board.getSize()) {
             return;
         }
 
         if (!pieceSelected) {
-            if (board.getTile(tileX, tileY).hasPiece() &&
-                board.getTile(tileX, tileY).getPiece()->getColor() == currentTurn) {
+            // Pieces of the side not on turn can be selected too; their move becomes a premove.
+            if (board.getTile(tileX, tileY).hasPiece()) {
                 pieceSelected = true;
                 selectedX = tileX;
                 selectedY = tileY;
 
-                validMoves.clear();
-                for (int y = 0; y < board.getSize(); ++y) {
-                    for (int x = 0; x < board.getSize(); ++x) {
-                        if (board.validate(selectedX, selectedY, x, y,
-                            currentTurn,
-                            board.getTile(selectedX, selectedY).getPiece()->getType())) {
-                            validMoves.emplace_back(x, y);
-                        }
-                    }
+                if (board.getTile(tileX, tileY).getPiece()->getColor() == currentTurn) {
+                    computeValidMoves(board, selectedX, selectedY, validMoves);
+                }
+                else {
+                    computePremoveTargets(board, selectedX, selectedY, validMoves);
                 }
             }
             else {
+                premove.reset();
                 return;
             }
         }
         else {
             if (std::find(validMoves.begin(), validMoves.end(), std::make_pair(tileX, tileY)) != validMoves.end()) {
-                isAnimating = true;
-                animationTime = 0.0f;
-                animStartX = selectedX;
-                animStartY = selectedY;
-                animEndX = tileX;
-                animEndY = tileY;
-                animatingPiece = *board.getTile(selectedX, selectedY).getPiece();
+                Piece piece = *board.getTile(selectedX, selectedY).getPiece();
+                if (piece.getColor() == currentTurn) {
+                    commitMove(board, selectedX, selectedY, tileX, tileY);
+                }
+                else {
+                    premove = Move{ selectedX, selectedY, tileX, tileY, piece.getType(), piece.getColor(), PieceType::none };
+                }
 
                 pieceSelected = false;
                 validMoves.clear();
@@ -777,123 +1229,2918 @@ void handlePlayerInput(Board& board, PieceColor currentTurn,
     }
 }
 
-int main()
-{
-    const int screenWidth = 640 + 2 * 20;
-    const int screenHeight = 640 + 2 * 20;
+// Micro-benchmarks for the Board hot paths (run with --bench)
 
-    InitWindow(screenWidth, screenHeight, "Chess Game");
+#ifdef CHESS_BENCH_ALLOC_COUNT
+// Counting global operator new. It replaces the allocator for the whole program, so it is
+// only built when CHESS_BENCH_ALLOC_COUNT is defined; the default build reports no allocations.
+const bool benchCountsAllocations = true;
 
-    Board chessBoard;
-    loadTextures();
+// Per thread so the parallel modes do not contend on a shared counter; the bench runs on the main thread.
+thread_local uint64_t allocationCount = 0;
 
-    bool pieceSelected = false;
-    int selectedX = -1, selectedY = -1;
-    std::vector<std::pair<int, int>> validMoves;
+void* operator new(size_t bytes) {
+    ++allocationCount;
+    if (void* ptr = std::malloc(bytes ? bytes : 1)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
 
-    chessBoard.placePiece(0, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(1, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(2, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(3, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(4, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(5, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(6, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(7, 1, PieceType::pawn, PieceColor::white);
-    chessBoard.placePiece(7, 0, PieceType::rook, PieceColor::white);
-    chessBoard.placePiece(0, 0, PieceType::rook, PieceColor::white);
-    chessBoard.placePiece(6, 0, PieceType::knight, PieceColor::white);
-    chessBoard.placePiece(1, 0, PieceType::knight, PieceColor::white);
-    chessBoard.placePiece(5, 0, PieceType::bishop, PieceColor::white);
-    chessBoard.placePiece(2, 0, PieceType::bishop, PieceColor::white);
-    chessBoard.placePiece(4, 0, PieceType::queen, PieceColor::white);
-    chessBoard.placePiece(3, 0, PieceType::king, PieceColor::white);
-
-    chessBoard.placePiece(0, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(1, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(2, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(3, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(4, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(5, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(6, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(7, 6, PieceType::pawn, PieceColor::black);
-    chessBoard.placePiece(7, 7, PieceType::rook, PieceColor::black);
-    chessBoard.placePiece(0, 7, PieceType::rook, PieceColor::black);
-    chessBoard.placePiece(6, 7, PieceType::knight, PieceColor::black);
-    chessBoard.placePiece(1, 7, PieceType::knight, PieceColor::black);
-    chessBoard.placePiece(5, 7, PieceType::bishop, PieceColor::black);
-    chessBoard.placePiece(2, 7, PieceType::bishop, PieceColor::black);
-    chessBoard.placePiece(4, 7, PieceType::queen, PieceColor::black);
-    chessBoard.placePiece(3, 7, PieceType::king, PieceColor::black);
-
-    SetTargetFPS(60);
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
 
-    while (!WindowShouldClose()) {
-        float deltaTime = GetFrameTime();
+uint64_t allocationsSoFar() { return allocationCount; }
+#else
+const bool benchCountsAllocations = false;
+
+uint64_t allocationsSoFar() { return 0; }
+#endif
+
+const std::vector<std::string> benchCorpus = {
+    startingPositionFen,
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3",
+    "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1",
+    "3R2k1/5ppp/8/8/8/8/5PPP/6K1 b - - 0 1",
+};
 
-        if (isAnimating) {
-            updateAnimation(chessBoard, deltaTime);
+struct BenchResult {
+    std::string name;
+    double nsPerOp = 0.0;
+    double stdDevNs = 0.0;
+    double allocsPerOp = 0.0;
+};
+
+volatile uint64_t benchSink = 0;
+
+// Runs fn() in batches after a warmup and reports the median batch time per call.
+template <typename Fn>
+BenchResult runBenchmark(const std::string& name, int opsPerCall, Fn&& fn) {
+    const int warmupCalls = 20;
+    const int samples = 15;
+    const int callsPerSample = 50;
+
+    for (int i = 0; i < warmupCalls; ++i) {
+        benchSink = benchSink + fn();
+    }
+
+    std::vector<double> times;
+    uint64_t allocations = 0;
+    for (int s = 0; s < samples; ++s) {
+        uint64_t allocsBefore = allocationsSoFar();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < callsPerSample; ++i) {
+            benchSink = benchSink + fn();
         }
-        else {
-            PieceColor currentTurn = chessBoard.isTurnValid(PieceColor::white) ? PieceColor::white : PieceColor::black;
+        auto end = std::chrono::steady_clock::now();
+        allocations += allocationsSoFar() - allocsBefore;
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        times.push_back(ns / (double(callsPerSample) * opsPerCall));
+    }
 
-            if (chessBoard.isThreefoldRepetition()) {
-                BeginDrawing();
-                ClearBackground(BLACK);
-                DrawText("Draw by threefold repetition!", 100, 100, 20, BLUE);
-                EndDrawing();
-                continue;
-            }
-            if (chessBoard.isFiftyMoveRuleDraw()) {
-                BeginDrawing();
-                ClearBackground(BLACK);
-                DrawText("Draw by fifty-move rule!", 100, 100, 20, BLUE);
-                EndDrawing();
-                continue;
-            }
+    std::sort(times.begin(), times.end());
+    double mean = 0.0;
+    for (double t : times) mean += t;
+    mean /= times.size();
+    double variance = 0.0;
+    for (double t : times) variance += (t - mean) * (t - mean);
+
+    BenchResult result;
+    result.name = name;
+    result.nsPerOp = times[times.size() / 2];
+    result.stdDevNs = std::sqrt(variance / times.size());
+    result.allocsPerOp = double(allocations) / (double(samples) * callsPerSample * opsPerCall);
+    return result;
+}
 
-            if (chessBoard.isKingInCheckmate(currentTurn)) {
-                BeginDrawing();
-                ClearBackground(BLACK);
-                DrawText("Checkmate! Game Over.", 100, 100, 20, RED);
-                EndDrawing();
-                continue;
+template <typename Storage>
+void runBoardBenchmarks(std::vector<BenchResult>& results) {
+    using BoardType = BasicBoard<Storage>;
+    const std::string prefix = std::string(Storage::name) + "/";
+
+    std::vector<BoardType> boards;
+    std::vector<std::vector<Move>> legalMoves;
+    int totalMoves = 0;
+    int totalPieces = 0;
+    for (const std::string& fen : benchCorpus) {
+        boards.emplace_back();
+        BoardType& board = boards.back();
+        board.loadFen(fen);
+
+        std::vector<Move> moves = board.generateLegalMoves();
+        for (int y = 0; y < board.getSize(); ++y) {
+            for (int x = 0; x < board.getSize(); ++x) {
+                const Tile& tile = board.getTile(x, y);
+                totalPieces += tile.hasPiece() && tile.getPiece()->getColor() == board.getCurrentTurn();
             }
-            else if (chessBoard.isStalemate(currentTurn)) {
-                BeginDrawing();
-                ClearBackground(BLACK);
-                DrawText("Stalemate! Game Draw.", 100, 100, 20, YELLOW);
-                EndDrawing();
-                continue;
+        }
+        totalMoves += (int)moves.size();
+        legalMoves.push_back(moves);
+    }
+    const int positions = (int)boards.size();
+
+    results.push_back(runBenchmark(prefix + "isKingInCheck", positions, [&]() {
+        uint64_t hits = 0;
+        for (BoardType& board : boards) hits += board.isKingInCheck(board.getCurrentTurn());
+        return hits;
+    }));
+    results.push_back(runBenchmark(prefix + "validate", totalMoves, [&]() {
+        uint64_t hits = 0;
+        for (int i = 0; i < positions; ++i) {
+            for (const Move& m : legalMoves[i]) {
+                hits += boards[i].validate(m.startX, m.startY, m.endX, m.endY, m.color, m.type);
             }
-            else {
-                if (pendingPromotion) {
-                    BeginDrawing();
-                    ClearBackground(BLACK);
-                    drawBoard(chessBoard, validMoves, selectedX, selectedY, pieceSelected);
-                    drawPromotionUI(promotionColor);
-                    EndDrawing();
-
-                    PieceType choice = handlePromotionInput(promotionColor);
-                    if (choice != none) {
-                        chessBoard.promotePawn(promotionX, promotionY, choice, promotionColor);
-                        pendingPromotion = false;
+        }
+        return hits;
+    }));
+    results.push_back(runBenchmark(prefix + "isKingInCheckmate", positions, [&]() {
+        uint64_t hits = 0;
+        for (BoardType& board : boards) hits += board.isKingInCheckmate(board.getCurrentTurn());
+        return hits;
+    }));
+    results.push_back(runBenchmark(prefix + "isStalemate", positions, [&]() {
+        uint64_t hits = 0;
+        for (BoardType& board : boards) hits += board.isStalemate(board.getCurrentTurn());
+        return hits;
+    }));
+    results.push_back(runBenchmark(prefix + "generatePositionKey", positions, [&]() {
+        uint64_t hash = 0;
+        for (BoardType& board : boards) hash ^= hashPositionKey(board.generatePositionKey());
+        return hash;
+    }));
+    results.push_back(runBenchmark(prefix + "copyBoard", positions, [&]() {
+        uint64_t hash = 0;
+        for (BoardType& board : boards) {
+            BoardType copy = board;
+            hash ^= copy.getPositionHash();
+        }
+        return hash;
+    }));
+    // Includes the board copy measured above, since makeMove has no undo.
+    results.push_back(runBenchmark(prefix + "makeMove", positions, [&]() {
+        uint64_t hash = 0;
+        for (int i = 0; i < positions; ++i) {
+            if (legalMoves[i].empty()) continue;
+            const Move& m = legalMoves[i].front();
+            BoardType copy = boards[i];
+            copy.makeMove(m.startX, m.startY, m.endX, m.endY, m.color, m.type);
+            hash ^= copy.getPositionHash();
+        }
+        return hash;
+    }));
+    results.push_back(runBenchmark(prefix + "selectionHighlight", totalPieces, [&]() {
+        uint64_t count = 0;
+        std::vector<std::pair<int, int>> targets;
+        for (BoardType& board : boards) {
+            for (int y = 0; y < board.getSize(); ++y) {
+                for (int x = 0; x < board.getSize(); ++x) {
+                    const Tile& tile = board.getTile(x, y);
+                    if (tile.hasPiece() && tile.getPiece()->getColor() == board.getCurrentTurn()) {
+                        computeValidMoves(board, x, y, targets);
+                        count += targets.size();
                     }
-                    continue;
-                }
-
-                BeginDrawing();
-                ClearBackground(BLACK);
-                if (chessBoard.isKingInCheck(currentTurn)) {
-                    DrawText("Check!", 100, 100, 20, ORANGE);
                 }
-                handlePlayerInput(chessBoard, currentTurn, validMoves, selectedX, selectedY, pieceSelected);
             }
         }
+        return count;
+    }));
+}
 
-        BeginDrawing();
-        ClearBackground(BLACK);
-        drawBoard(chessBoard, validMoves, selectedX, selectedY, pieceSelected);
-        EndDrawing();
+std::string benchResultsToJson(const std::vector<BenchResult>& results) {
+    std::ostringstream oss;
+    oss.setf(std::ios::fixed);
+    oss.precision(2);
+    oss << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        oss << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << r.nsPerOp
+            << ", \"stddev_ns\": " << r.stdDevNs;
+        if (benchCountsAllocations) oss << ", \"allocs_per_op\": " << r.allocsPerOp;
+        oss << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    oss << "  ]\n}\n";
+    return oss.str();
+}
+
+// Reads name -> ns_per_op from a file previously written by benchResultsToJson.
+std::map<std::string, double> loadBenchBaseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Cannot open baseline file: " + path);
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t namePos = line.find("\"name\": \"");
+        size_t nsPos = line.find("\"ns_per_op\": ");
+        if (namePos == std::string::npos || nsPos == std::string::npos) continue;
+        namePos += 9;
+        std::string name = line.substr(namePos, line.find('"', namePos) - namePos);
+        baseline[name] = std::stod(line.substr(nsPos + 13));
+    }
+    return baseline;
+}
+
+// --bench [--out file] [--baseline file] [--threshold percent]
+int runBenchMode(int argc, char** argv) {
+    std::string outPath;
+    std::string baselinePath;
+    double thresholdPercent = 10.0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--out") outPath = argv[i + 1];
+        else if (flag == "--baseline") baselinePath = argv[i + 1];
+        else if (flag == "--threshold") thresholdPercent = std::stod(argv[i + 1]);
+    }
+
+    std::vector<BenchResult> results;
+    runBoardBenchmarks<GridStorage>(results);
+    runBoardBenchmarks<MailboxStorage>(results);
+    std::string json = benchResultsToJson(results);
+    std::cout << json;
+    if (!outPath.empty()) {
+        std::ofstream(outPath) << json;
+    }
+
+    if (baselinePath.empty()) return 0;
+
+    std::map<std::string, double> baseline = loadBenchBaseline(baselinePath);
+    int regressions = 0;
+    for (const BenchResult& r : results) {
+        auto it = baseline.find(r.name);
+        if (it == baseline.end() || it->second <= 0.0) continue;
+        double change = (r.nsPerOp - it->second) / it->second * 100.0;
+        bool regressed = change > thresholdPercent;
+        regressions += regressed;
+        std::cerr << (regressed ? "REGRESSION " : "ok         ") << r.name << ": "
+            << it->second << " -> " << r.nsPerOp << " ns/op (" << (change >= 0 ? "+" : "") << change << "%)\n";
+    }
+    return regressions > 0 ? 1 : 0;
+}
+
+// Mate-in-N solver using depth-first proof-number search (run with --mate)
+
+const uint32_t proofInfinity = 1u << 30;
+
+struct ProofEntry {
+    uint64_t key = 0;
+    uint32_t proof = 1;
+    uint32_t disproof = 1;
+};
+
+enum MateResult {
+    mateUnknown,
+    mateProven,
+    mateDisproven,
+};
+
+// The attacker only tries checking moves; the defender tries everything. Proof and
+// disproof numbers live in a fixed-size table, so memory stays bounded regardless
+// of how large the tree gets (entries are simply overwritten on collision).
+class MateSolver {
+public:
+    MateSolver(size_t tableBytes, uint64_t nodeLimit)
+        : table(std::max<size_t>(1, tableBytes / sizeof(ProofEntry))), nodeLimit(nodeLimit), nodes(0), aborted(false)
+    {
+    }
+
+    MateResult solve(const Board& board, int moves, Move& firstMove) {
+        std::fill(table.begin(), table.end(), ProofEntry());
+        nodes = 0;
+        aborted = false;
+
+        int bestChild = -1;
+        std::vector<Move> rootMoves;
+        Board root = board;
+        uint32_t proof = 0, disproof = 0;
+        search(root, 2 * moves - 1, true, proofInfinity, proofInfinity, proof, disproof, &bestChild, &rootMoves);
+
+        if (proof == 0) {
+            firstMove = rootMoves[bestChild];
+            return mateProven;
+        }
+        return disproof == 0 ? mateDisproven : mateUnknown;
+    }
+
+    uint64_t getNodes() const { return nodes; }
+    size_t getTableBytes() const { return table.size() * sizeof(ProofEntry); }
+
+    size_t getUsedEntries() const {
+        return std::count_if(table.begin(), table.end(), [](const ProofEntry& e) { return e.key != 0; });
+    }
+
+private:
+    std::vector<ProofEntry> table;
+    uint64_t nodeLimit;
+    uint64_t nodes;
+    bool aborted;
+
+    static uint32_t saturatingAdd(uint32_t a, uint32_t b) {
+        return (uint32_t)std::min<uint64_t>(proofInfinity, uint64_t(a) + b);
+    }
+
+    static uint64_t makeKey(const Board& board, int pliesLeft) {
+        uint64_t key = board.getPositionHash() ^ (uint64_t(pliesLeft + 1) * 0x9E3779B97F4A7C15ull);
+        return key ? key : 1;
+    }
+
+    void lookup(uint64_t key, uint32_t& proof, uint32_t& disproof) const {
+        const ProofEntry& entry = table[key % table.size()];
+        if (entry.key == key) {
+            proof = entry.proof;
+            disproof = entry.disproof;
+        }
+        else {
+            proof = 1;
+            disproof = 1;
+        }
+    }
+
+    void store(uint64_t key, uint32_t proof, uint32_t disproof) {
+        table[key % table.size()] = { key, proof, disproof };
+    }
+
+    void search(Board& board, int pliesLeft, bool attacker, uint32_t proofThreshold, uint32_t disproofThreshold,
+        uint32_t& proof, uint32_t& disproof, int* bestChildOut = nullptr, std::vector<Move>* movesOut = nullptr) {
+        uint64_t key = makeKey(board, pliesLeft);
+        if (++nodes > nodeLimit) {
+            aborted = true;
+        }
+
+        std::vector<Move> moves;
+        std::vector<Board> children;
+        for (const Move& move : board.generateLegalMoves()) {
+            Board child = board;
+            child.applyMove(move);
+            if (attacker && !child.isKingInCheck(child.getCurrentTurn())) continue;
+            moves.push_back(move);
+            children.push_back(std::move(child));
+        }
+
+        bool proven = !attacker && children.empty() && board.isKingInCheck(board.getCurrentTurn());
+        bool disproven = !proven && (children.empty() || pliesLeft == 0);
+        if (proven || disproven || aborted) {
+            proof = proven ? 0 : (disproven ? proofInfinity : 1);
+            disproof = disproven ? 0 : (proven ? proofInfinity : 1);
+            if (!aborted) store(key, proof, disproof);
+            return;
+        }
+
+        std::vector<uint64_t> childKeys;
+        for (const Board& child : children) {
+            childKeys.push_back(makeKey(child, pliesLeft - 1));
+        }
+
+        while (true) {
+            // At attacker nodes one proven child suffices; at defender nodes all must be proven.
+            uint32_t best = proofInfinity + 1, second = proofInfinity + 1;
+            int bestIndex = 0;
+            uint32_t bestProof = 0, bestDisproof = 0;
+            uint32_t sum = 0;
+            for (int i = 0; i < (int)children.size(); ++i) {
+                uint32_t childProof, childDisproof;
+                lookup(childKeys[i], childProof, childDisproof);
+                uint32_t minimized = attacker ? childProof : childDisproof;
+                sum = saturatingAdd(sum, attacker ? childDisproof : childProof);
+                if (minimized < best) {
+                    second = best;
+                    best = minimized;
+                    bestIndex = i;
+                    bestProof = childProof;
+                    bestDisproof = childDisproof;
+                }
+                else if (minimized < second) {
+                    second = minimized;
+                }
+            }
+            proof = attacker ? best : sum;
+            disproof = attacker ? sum : best;
+
+            if (bestChildOut) *bestChildOut = bestIndex;
+            if (proof >= proofThreshold || disproof >= disproofThreshold || aborted) {
+                if (movesOut) *movesOut = moves;
+                store(key, proof, disproof);
+                return;
+            }
+
+            uint32_t childProofThreshold, childDisproofThreshold;
+            if (attacker) {
+                childProofThreshold = std::min(proofThreshold, saturatingAdd(second, 1));
+                childDisproofThreshold = disproofThreshold >= proofInfinity
+                    ? proofInfinity : disproofThreshold - disproof + bestDisproof;
+            }
+            else {
+                childDisproofThreshold = std::min(disproofThreshold, saturatingAdd(second, 1));
+                childProofThreshold = proofThreshold >= proofInfinity
+                    ? proofInfinity : proofThreshold - proof + bestProof;
+            }
+
+            uint32_t childProof, childDisproof;
+            search(children[bestIndex], pliesLeft - 1, !attacker, childProofThreshold, childDisproofThreshold,
+                childProof, childDisproof);
+            store(childKeys[bestIndex], childProof, childDisproof);
+        }
+    }
+};
+
+// --mate <fen file> <moves> [--threads n] [--table-mb m] [--nodes limit]
+int runMateMode(int argc, char** argv) {
+    std::string fenPath = argv[2];
+    char* end = nullptr;
+    long mateMoves = std::strtol(argv[3], &end, 10);
+    if (end == argv[3] || *end != '\0' || mateMoves < 1 || mateMoves > 100) {
+        std::cerr << "Mate depth " << argv[3] << " is not a number of moves from 1 to 100\n";
+        return 1;
+    }
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    size_t tableMegabytes = 16;
+    uint64_t nodeLimit = 2000000;
+    try {
+        for (int i = 4; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            if (flag == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+            else if (flag == "--table-mb") tableMegabytes = std::stoul(argv[i + 1]);
+            else if (flag == "--nodes") nodeLimit = std::stoull(argv[i + 1]);
+        }
+    }
+    catch (const std::exception&) {
+        std::cerr << "Usage: --mate <fen file> <moves> [--threads n] [--table-mb m] [--nodes limit]\n";
+        return 1;
+    }
+
+    std::vector<std::string> fens;
+    std::ifstream in(fenPath);
+    if (!in) {
+        std::cerr << "Cannot open " << fenPath << "\n";
+        return 1;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') fens.push_back(line);
+    }
+
+    struct PuzzleResult {
+        MateResult result = mateUnknown;
+        std::string move;
+        uint64_t nodes = 0;
+        std::string error;
+    };
+    std::vector<PuzzleResult> results(fens.size());
+    std::atomic<size_t> nextPuzzle{ 0 };
+    std::atomic<size_t> peakTableEntries{ 0 };
+    size_t tableBytes = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    std::mutex setupMutex;
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&]() {
+            MateSolver solver(tableMegabytes * 1024 * 1024, nodeLimit);
+            {
+                std::lock_guard<std::mutex> lock(setupMutex);
+                tableBytes += solver.getTableBytes();
+            }
+            size_t index;
+            while ((index = nextPuzzle.fetch_add(1)) < fens.size()) {
+                PuzzleResult& result = results[index];
+                try {
+                    Board board;
+                    board.loadFen(fens[index]);
+                    // Both kings must exist; findKing throws otherwise.
+                    board.isKingInCheck(PieceColor::white);
+                    board.isKingInCheck(PieceColor::black);
+                    Move firstMove{};
+                    result.result = solver.solve(board, mateMoves, firstMove);
+                    result.nodes = solver.getNodes();
+                    if (result.result == mateProven) result.move = toCoordinateNotation(firstMove);
+                }
+                catch (const std::exception& e) {
+                    // Malformed FEN, or a position the rules cannot handle (e.g. a missing king)
+                    result = PuzzleResult();
+                    result.error = e.what();
+                    continue;
+                }
+
+                size_t used = solver.getUsedEntries();
+                size_t peak = peakTableEntries.load();
+                while (used > peak && !peakTableEntries.compare_exchange_weak(peak, used)) {}
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int proven = 0, disproven = 0, badFens = 0;
+    uint64_t totalNodes = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const PuzzleResult& r = results[i];
+        if (!r.error.empty()) {
+            ++badFens;
+            std::cerr << "Puzzle " << i + 1 << ": " << r.error << "\n";
+            std::cout << i + 1 << " bad-fen - nodes=0\n";
+            continue;
+        }
+        proven += r.result == mateProven;
+        disproven += r.result == mateDisproven;
+        totalNodes += r.nodes;
+        const char* verdict = r.result == mateProven ? "mate" : (r.result == mateDisproven ? "no-mate" : "unknown");
+        std::cout << i + 1 << " " << verdict << " " << (r.move.empty() ? "-" : r.move) << " nodes=" << r.nodes << "\n";
+    }
+    std::cout << "puzzles=" << results.size() << " proven=" << proven << " disproven=" << disproven
+        << " unknown=" << results.size() - proven - disproven - badFens << " bad-fen=" << badFens
+        << " threads=" << threadCount << "\n"
+        << "seconds=" << seconds << " proofs/sec=" << (proven + disproven) / seconds
+        << " nodes/sec=" << totalNodes / seconds << "\n"
+        << "table memory=" << tableBytes / (1024.0 * 1024.0) << " MB, peak entries per table="
+        << peakTableEntries.load() << "\n";
+    return 0;
+}
+
+// Batch game annotation: evaluation and best move for every ply (run with --annotate)
+
+const int mateScore = 100000;
+
+int pieceValue(PieceType type) {
+    switch (type) {
+    case pawn: return 100;
+    case knight: return 320;
+    case bishop: return 330;
+    case rook: return 500;
+    case queen: return 900;
+    default: return 0;
+    }
+}
+
+// Material balance from the point of view of the side to move.
+int evaluateMaterial(Board& board) {
+    int score = 0;
+    for (int y = 0; y < board.getSize(); ++y) {
+        for (int x = 0; x < board.getSize(); ++x) {
+            const Tile& tile = board.getTile(x, y);
+            if (!tile.hasPiece()) continue;
+            int value = pieceValue(tile.getPiece()->getType());
+            score += tile.getPiece()->getColor() == board.getCurrentTurn() ? value : -value;
+        }
+    }
+    return score;
+}
+
+struct SearchResult {
+    int score = 0;
+    int depth = 0;
+    uint64_t nodes = 0;
+    std::optional<Move> bestMove;
+};
+
+// Iterative-deepening alpha-beta under a node budget. The transposition table is kept
+// between calls, so analysing consecutive plies of one game reuses earlier work.
+class Searcher {
+public:
+    explicit Searcher(size_t tableEntries) : table(tableEntries) {}
+
+    void clear() {
+        std::fill(table.begin(), table.end(), TableEntry());
+    }
+
+    SearchResult search(const Board& position, uint64_t nodeBudget) {
+        SearchResult result;
+        nodes = 0;
+        nodeLimit = nodeBudget;
+        aborted = false;
+
+        Board board = position;
+        std::vector<Move> rootMoves = board.generateLegalMoves();
+        if (rootMoves.empty()) {
+            result.score = board.isKingInCheck(board.getCurrentTurn()) ? -mateScore : 0;
+            return result;
+        }
+
+        for (int depth = 1; depth < 64 && !aborted; ++depth) {
+            int score = negamax(board, depth, -mateScore - 1, mateScore + 1, 0);
+            if (aborted) break;
+            const TableEntry& entry = table[board.getPositionHash() % table.size()];
+            result.score = score;
+            result.depth = depth;
+            if (entry.key == board.getPositionHash() && entry.bestMove < rootMoves.size()) {
+                result.bestMove = rootMoves[entry.bestMove];
+            }
+            if (std::abs(score) >= mateScore - 64) break;
+        }
+        result.nodes = nodes;
+        return result;
+    }
+
+private:
+    enum Bound : uint8_t { exact, lower, upper };
+
+    struct TableEntry {
+        uint64_t key = 0;
+        int score = 0;
+        int8_t depth = -1;
+        Bound bound = exact;
+        uint8_t bestMove = 255;
+    };
+
+    std::vector<TableEntry> table;
+    uint64_t nodes = 0;
+    uint64_t nodeLimit = 0;
+    bool aborted = false;
+
+    // Resolves captures at the horizon so odd depths do not end on a free pawn.
+    int quiesce(Board& board, int alpha, int beta, const std::vector<Move>& moves) {
+        int standPat = evaluateMaterial(board);
+        if (standPat >= beta) return standPat;
+        alpha = std::max(alpha, standPat);
+
+        for (const Move& move : moves) {
+            if (!board.getTile(move.endX, move.endY).hasPiece()) continue;
+            if (++nodes > nodeLimit) {
+                aborted = true;
+                return 0;
+            }
+            Board child = board;
+            child.applyMove(move);
+            std::vector<Move> replies = child.generateLegalMoves();
+            int score = replies.empty()
+                ? (child.isKingInCheck(child.getCurrentTurn()) ? mateScore - 1 : 0)
+                : -quiesce(child, -beta, -alpha, replies);
+            if (aborted) return 0;
+            if (score >= beta) return score;
+            alpha = std::max(alpha, score);
+        }
+        return alpha;
+    }
+
+    int negamax(Board& board, int depth, int alpha, int beta, int ply) {
+        if (++nodes > nodeLimit) {
+            aborted = true;
+            return 0;
+        }
+
+        uint64_t key = board.getPositionHash();
+        TableEntry& entry = table[key % table.size()];
+        uint8_t hashMove = 255;
+        if (entry.key == key) {
+            hashMove = entry.bestMove;
+            if (entry.depth >= depth && ply > 0) {
+                if (entry.bound == exact) return entry.score;
+                if (entry.bound == lower && entry.score >= beta) return entry.score;
+                if (entry.bound == upper && entry.score <= alpha) return entry.score;
+            }
+        }
+
+        std::vector<Move> moves = board.generateLegalMoves();
+        if (moves.empty()) {
+            return board.isKingInCheck(board.getCurrentTurn()) ? -(mateScore - ply) : 0;
+        }
+        if (depth == 0) {
+            return quiesce(board, alpha, beta, moves);
+        }
+
+        // Previous best move first, then the rest in generation order.
+        std::vector<uint8_t> order;
+        if (hashMove < moves.size()) order.push_back(hashMove);
+        for (int i = 0; i < (int)moves.size(); ++i) {
+            if (i != hashMove) order.push_back((uint8_t)i);
+        }
+
+        int originalAlpha = alpha;
+        int bestScore = -mateScore - 1;
+        uint8_t bestMove = order.front();
+        for (uint8_t index : order) {
+            Board child = board;
+            child.applyMove(moves[index]);
+            int score = -negamax(child, depth - 1, -beta, -alpha, ply + 1);
+            if (aborted) return 0;
+            if (score > bestScore) {
+                bestScore = score;
+                bestMove = index;
+            }
+            alpha = std::max(alpha, score);
+            if (alpha >= beta) break;
+        }
+
+        entry.key = key;
+        entry.score = bestScore;
+        entry.depth = (int8_t)depth;
+        entry.bestMove = bestMove;
+        entry.bound = bestScore <= originalAlpha ? upper : (bestScore >= beta ? lower : exact);
+        return bestScore;
+    }
+};
+
+// Index of the move written as text in a generateLegalMoves() list, or -1.
+int findMoveIndex(const std::vector<Move>& moves, const std::string& text) {
+    for (int i = 0; i < (int)moves.size(); ++i) {
+        std::string notation = toCoordinateNotation(moves[i]);
+        // A bare "e7e8" promotes to a queen.
+        if (notation == text || (notation == text + "q")) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool parseCoordinateMove(Board& board, const std::string& text, Move& move) {
+    std::vector<Move> moves = board.generateLegalMoves();
+    int index = findMoveIndex(moves, text);
+    if (index < 0) return false;
+    move = moves[index];
+    return true;
+}
+
+// A game file is whitespace-separated coordinate moves from the starting position;
+// lines starting with '#' are comments.
+std::vector<std::string> loadGameMoves(const std::string& path) {
+    std::vector<std::string> moves;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] == '#') continue;
+        std::istringstream tokens(line);
+        std::string token;
+        while (tokens >> token) moves.push_back(token);
+    }
+    return moves;
+}
+
+struct PlyAnnotation {
+    std::string played;
+    std::string best;
+    int scoreForWhite = 0;
+    int depth = 0;
+    bool searched = false;
+};
+
+struct AnnotatedGame {
+    std::string name;
+    std::vector<std::string> moves;
+    std::vector<PlyAnnotation> plies;
+    int illegalPly = -1;
+    std::atomic<bool> finished{ false };
+};
+
+// --annotate <games dir> <output file> [--threads n] [--nodes per-ply]
+int runAnnotateMode(int argc, char** argv) {
+    std::string gamesDir = argv[2];
+    std::string outPath = argv[3];
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t nodesPerPly = 20000;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--nodes") nodesPerPly = std::stoull(argv[i + 1]);
+    }
+
+    std::vector<std::string> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(gamesDir)) {
+        if (entry.is_regular_file()) paths.push_back(entry.path().string());
+    }
+    std::sort(paths.begin(), paths.end());
+
+    std::vector<std::unique_ptr<AnnotatedGame>> games;
+    for (const std::string& path : paths) {
+        auto game = std::make_unique<AnnotatedGame>();
+        game->name = std::filesystem::path(path).filename().string();
+        game->moves = loadGameMoves(path);
+        game->plies.resize(game->moves.size());
+        games.push_back(std::move(game));
+    }
+    // A job is a whole game, so each ply is searched straight after the previous one on the
+    // same board and transposition table. Longest games go first to keep the workers balanced.
+    std::vector<size_t> jobs(games.size());
+    for (size_t i = 0; i < jobs.size(); ++i) jobs[i] = i;
+    std::stable_sort(jobs.begin(), jobs.end(),
+        [&](size_t a, size_t b) { return games[a]->moves.size() > games[b]->moves.size(); });
+
+    std::ofstream out(outPath);
+    std::mutex outputMutex;
+    size_t nextGameToWrite = 0;
+    // Writes finished games in input order as soon as the next one is complete.
+    auto flushCompletedGames = [&]() {
+        std::lock_guard<std::mutex> lock(outputMutex);
+        while (nextGameToWrite < games.size() && games[nextGameToWrite]->finished) {
+            AnnotatedGame& game = *games[nextGameToWrite];
+            out << "# " << game.name << "\n";
+            if (game.illegalPly >= 0) {
+                std::cerr << game.name << ": illegal or unreadable move '" << game.moves[game.illegalPly]
+                    << "' at ply " << game.illegalPly + 1 << ", later plies skipped\n";
+            }
+            for (size_t ply = 0; ply < game.plies.size(); ++ply) {
+                const PlyAnnotation& a = game.plies[ply];
+                if (!a.searched) {
+                    out << ply + 1 << " " << game.moves[ply] << " skipped\n";
+                    continue;
+                }
+                out << ply + 1 << " " << a.played << " eval=" << a.scoreForWhite << " best=" << a.best
+                    << " depth=" << a.depth << "\n";
+            }
+            out.flush();
+            game.moves.clear();
+            game.plies.clear();
+            ++nextGameToWrite;
+        }
+    };
+
+    std::atomic<size_t> nextJob{ 0 };
+    std::atomic<uint64_t> pliesDone{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&]() {
+            Searcher searcher(1 << 18);
+            Board board;
+            size_t job;
+            while ((job = nextJob.fetch_add(1)) < jobs.size()) {
+                AnnotatedGame& game = *games[jobs[job]];
+                // Cleared per game so the output does not depend on which games a worker ran before.
+                searcher.clear();
+                board.loadFen(startingPositionFen);
+
+                int searched = 0;
+                for (int ply = 0; ply < (int)game.moves.size(); ++ply) {
+                    Move played{};
+                    bool valid = parseCoordinateMove(board, game.moves[ply], played);
+                    PlyAnnotation& annotation = game.plies[ply];
+                    annotation.played = game.moves[ply];
+                    SearchResult result = searcher.search(board, nodesPerPly);
+                    annotation.scoreForWhite = board.getCurrentTurn() == PieceColor::white ? result.score : -result.score;
+                    annotation.best = result.bestMove ? toCoordinateNotation(*result.bestMove) : "-";
+                    annotation.depth = result.depth;
+                    annotation.searched = true;
+                    ++searched;
+                    if (!valid) {
+                        // The position is unknown after this, so the rest of the game is skipped.
+                        annotation.played += "?";
+                        game.illegalPly = ply;
+                        break;
+                    }
+                    board.applyMove(played);
+                }
+
+                pliesDone += searched;
+                game.finished = true;
+                flushCompletedGames();
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    flushCompletedGames();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "games=" << games.size() << " plies=" << pliesDone.load() << " threads=" << threadCount
+        << " nodes/ply=" << nodesPerPly << " seconds=" << seconds << " plies/sec=" << pliesDone.load() / seconds << "\n";
+    return 0;
+}
+
+// Headless board diagrams drawn with the CPU Image API (run with --diagrams)
+
+// Standard orientation: White at the bottom, a-file on the left.
+void renderDiagram(Board& board, const Image& atlas, int tileSize, Image& target) {
+    for (int rank = 0; rank < board.getSize(); ++rank) {
+        for (int file = 0; file < board.getSize(); ++file) {
+            int px = file * tileSize;
+            int py = (board.getSize() - 1 - rank) * tileSize;
+            ImageDrawRectangle(&target, px, py, tileSize, tileSize, (rank + file) % 2 == 0 ? DARKGRAY : RAYWHITE);
+
+            const Tile& tile = board.getTile(board.getSize() - 1 - file, rank);
+            if (!tile.hasPiece()) continue;
+            Rectangle source = atlasCell(atlasIndex(*tile.getPiece()), atlas.width, atlas.height);
+            // Pieces are scaled down when the tile is smaller than the source image.
+            float pieceSize = std::min((float)tileSize, source.width);
+            Rectangle dest = { px + (tileSize - pieceSize) / 2, py + (tileSize - pieceSize) / 2, pieceSize, pieceSize };
+            ImageDraw(&target, atlas, source, dest, WHITE);
+        }
+    }
+}
+
+// Rendered diagrams waiting to be encoded, plus the buffers free for reuse. Bounding
+// the buffer count keeps memory flat when PNG encoding falls behind rendering.
+class DiagramQueue {
+public:
+    DiagramQueue(int bufferCount, int width, int height) {
+        for (int i = 0; i < bufferCount; ++i) {
+            freeBuffers.push_back(GenImageColor(width, height, BLANK));
+        }
+    }
+
+    ~DiagramQueue() {
+        for (Image& image : freeBuffers) UnloadImage(image);
+    }
+
+    Image acquireBuffer() {
+        std::unique_lock<std::mutex> lock(mutex);
+        bufferFreed.wait(lock, [&]() { return !freeBuffers.empty(); });
+        Image image = freeBuffers.back();
+        freeBuffers.pop_back();
+        return image;
+    }
+
+    void releaseBuffer(Image image) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeBuffers.push_back(image);
+        bufferFreed.notify_one();
+    }
+
+    void push(std::string path, Image image) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.emplace_back(std::move(path), image);
+        workReady.notify_one();
+    }
+
+    // Returns false once close() has been called and nothing is left to write.
+    bool pop(std::string& path, Image& image) {
+        std::unique_lock<std::mutex> lock(mutex);
+        workReady.wait(lock, [&]() { return !pending.empty() || closed; });
+        if (pending.empty()) return false;
+        path = std::move(pending.front().first);
+        image = pending.front().second;
+        pending.pop_front();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        workReady.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable bufferFreed;
+    std::deque<std::pair<std::string, Image>> pending;
+    std::vector<Image> freeBuffers;
+    bool closed = false;
+};
+
+// --diagrams <fen file> <output dir> [--threads n] [--writers n] [--tile px]
+int runDiagramMode(int argc, char** argv) {
+    std::string fenPath = argv[2];
+    std::string outDir = argv[3];
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    int writerCount = 0;
+    int tileSize = 80;
+    for (int i = 4; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--writers") writerCount = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--tile") tileSize = std::max(1, std::stoi(argv[i + 1]));
+    }
+    if (writerCount == 0) writerCount = threadCount;
+
+    std::vector<std::string> fens;
+    std::ifstream in(fenPath);
+    if (!in) {
+        std::cerr << "Cannot open " << fenPath << "\n";
+        return 1;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') fens.push_back(line);
+    }
+    std::filesystem::create_directories(outDir);
+
+    // Decoded once and only read afterwards, so all workers share it without locking.
+    const Image atlas = loadPieceAtlasImage();
+    const int boardPixels = 8 * tileSize;
+
+    auto start = std::chrono::steady_clock::now();
+    DiagramQueue queue(2 * threadCount, boardPixels, boardPixels);
+    std::atomic<size_t> nextFen{ 0 };
+    std::atomic<int> failedWrites{ 0 };
+    std::atomic<int> badFens{ 0 };
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < writerCount; ++t) {
+        writers.emplace_back([&]() {
+            std::string path;
+            Image image;
+            while (queue.pop(path, image)) {
+                if (!ExportImage(image, path.c_str())) ++failedWrites;
+                queue.releaseBuffer(image);
+            }
+        });
+    }
+
+    std::vector<std::thread> renderers;
+    for (int t = 0; t < threadCount; ++t) {
+        renderers.emplace_back([&]() {
+            Board board;
+            size_t index;
+            while ((index = nextFen.fetch_add(1)) < fens.size()) {
+                // Parse before taking a buffer so a bad line cannot leak one.
+                try {
+                    board.loadFen(fens[index]);
+                }
+                catch (const std::exception& e) {
+                    std::cerr << "Position " << index + 1 << ": " << e.what() << "\n";
+                    ++badFens;
+                    continue;
+                }
+                Image image = queue.acquireBuffer();
+                renderDiagram(board, atlas, tileSize, image);
+
+                char name[40];
+                snprintf(name, sizeof(name), "diagram_%06zu.png", index + 1);
+                queue.push((std::filesystem::path(outDir) / name).string(), image);
+            }
+        });
+    }
+    for (std::thread& renderer : renderers) {
+        renderer.join();
+    }
+    queue.close();
+    for (std::thread& writer : writers) {
+        writer.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    UnloadImage(atlas);
+
+    int failed = failedWrites.load() + badFens.load();
+    size_t written = fens.size() - failed;
+    std::cout << "images=" << written << " failed=" << failed << " (bad-fen=" << badFens.load() << ", write="
+        << failedWrites.load() << ") threads=" << threadCount << " writers=" << writerCount
+        << " seconds=" << seconds << " images/sec=" << written / seconds << "\n";
+    return failed == 0 ? 0 : 1;
+}
+
+// Compact game archive (run with --archive-encode / --archive-decode / --archive-game)
+//
+// Each move is stored as its index in generateLegalMoves() for the current position,
+// so a move never needs more than a byte, and the indices are Huffman-coded per block.
+// Layout: header (magic, block count, game count, index offset), the blocks, then the
+// block index. A block holds 256 code lengths, a varint move count per game, a varint
+// payload size and the bitstream.
+
+const char archiveMagic[4] = { 'C', 'R', 'A', '1' };
+const int archiveGamesPerBlock = 256;
+const int archiveMaxCodeLength = 24;
+
+struct ArchiveBlockInfo {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t gameCount;
+    uint64_t firstGame;
+};
+
+void writeLittleEndian(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+uint64_t readLittleEndian(const uint8_t* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= uint64_t(data[i]) << (8 * i);
+    return value;
+}
+
+void writeVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+uint64_t readVarint(const uint8_t*& data, const uint8_t* end) {
+    uint64_t value = 0;
+    for (int shift = 0; data < end; shift += 7) {
+        uint8_t byte = *data++;
+        value |= uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+    throw std::runtime_error("Truncated archive block");
+}
+
+// Canonical Huffman code over move indices 0..255.
+class MoveIndexCode {
+public:
+    std::array<uint8_t, 256> lengths{};
+
+    static MoveIndexCode build(std::array<uint64_t, 256> frequencies) {
+        MoveIndexCode code;
+        // Halve the counts until the longest code fits; rare with 256-game blocks.
+        while (true) {
+            code.lengths = huffmanLengths(frequencies);
+            if (*std::max_element(code.lengths.begin(), code.lengths.end()) <= archiveMaxCodeLength) break;
+            for (uint64_t& f : frequencies) {
+                if (f) f = (f + 1) / 2;
+            }
+        }
+        code.assignCodes();
+        return code;
+    }
+
+    static MoveIndexCode fromLengths(const uint8_t* lengths) {
+        MoveIndexCode code;
+        std::copy(lengths, lengths + 256, code.lengths.begin());
+        code.assignCodes();
+        return code;
+    }
+
+    void write(std::vector<uint8_t>& out, uint64_t& bitBuffer, int& bitCount, int symbol) const {
+        bitBuffer = (bitBuffer << lengths[symbol]) | codes[symbol];
+        bitCount += lengths[symbol];
+        while (bitCount >= 8) {
+            bitCount -= 8;
+            out.push_back(uint8_t(bitBuffer >> bitCount));
+        }
+    }
+
+    int read(const uint8_t* data, size_t sizeInBits, size_t& bitPosition) const {
+        uint32_t code = 0;
+        for (int length = 1; length <= archiveMaxCodeLength; ++length) {
+            if (bitPosition >= sizeInBits) break;
+            code = (code << 1) | ((data[bitPosition / 8] >> (7 - bitPosition % 8)) & 1);
+            ++bitPosition;
+            if (code - firstCode[length] < countPerLength[length]) {
+                return sortedSymbols[firstIndex[length] + code - firstCode[length]];
+            }
+        }
+        throw std::runtime_error("Corrupt archive bitstream");
+    }
+
+private:
+    std::array<uint32_t, 256> codes{};
+    std::array<uint32_t, archiveMaxCodeLength + 1> firstCode{};
+    std::array<uint32_t, archiveMaxCodeLength + 1> countPerLength{};
+    std::array<uint32_t, archiveMaxCodeLength + 1> firstIndex{};
+    std::vector<int> sortedSymbols;
+
+    static std::array<uint8_t, 256> huffmanLengths(const std::array<uint64_t, 256>& frequencies) {
+        struct Node {
+            uint64_t weight;
+            int left, right;
+        };
+        std::vector<Node> nodes;
+        using Entry = std::pair<uint64_t, int>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+        for (int symbol = 0; symbol < 256; ++symbol) {
+            if (frequencies[symbol] == 0) continue;
+            heap.push({ frequencies[symbol], (int)nodes.size() });
+            nodes.push_back({ frequencies[symbol], -1, symbol });
+        }
+
+        std::array<uint8_t, 256> lengths{};
+        if (nodes.size() == 1) {
+            lengths[nodes[0].right] = 1;
+            return lengths;
+        }
+        while (heap.size() > 1) {
+            Entry a = heap.top(); heap.pop();
+            Entry b = heap.top(); heap.pop();
+            heap.push({ a.first + b.first, (int)nodes.size() });
+            nodes.push_back({ a.first + b.first, a.second, b.second });
+        }
+
+        // Leaves have left == -1 and keep their symbol in right.
+        std::vector<std::pair<int, int>> stack;
+        if (!heap.empty()) stack.push_back({ heap.top().second, 0 });
+        while (!stack.empty()) {
+            auto [index, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[index].left < 0) {
+                lengths[nodes[index].right] = (uint8_t)std::min(depth, 255);
+            }
+            else {
+                stack.push_back({ nodes[index].left, depth + 1 });
+                stack.push_back({ nodes[index].right, depth + 1 });
+            }
+        }
+        return lengths;
+    }
+
+    void assignCodes() {
+        sortedSymbols.clear();
+        for (int length = 1; length <= archiveMaxCodeLength; ++length) {
+            for (int symbol = 0; symbol < 256; ++symbol) {
+                if (lengths[symbol] == length) sortedSymbols.push_back(symbol);
+            }
+        }
+
+        uint32_t code = 0;
+        int index = 0;
+        for (int length = 1; length <= archiveMaxCodeLength; ++length) {
+            firstCode[length] = code;
+            firstIndex[length] = index;
+            countPerLength[length] = 0;
+            for (int symbol = 0; symbol < 256; ++symbol) {
+                if (lengths[symbol] != length) continue;
+                codes[symbol] = code++;
+                ++countPerLength[length];
+                ++index;
+            }
+            code <<= 1;
+        }
+    }
+};
+
+struct EncodedArchiveBlock {
+    std::vector<uint8_t> bytes;
+    uint64_t moveCount = 0;
+    int truncatedGames = 0;
+};
+
+// Games are lines of coordinate moves from the starting position. A game is cut at
+// its first illegal or unreadable move.
+EncodedArchiveBlock encodeArchiveBlock(const std::vector<std::string>& games, size_t first, size_t count) {
+    EncodedArchiveBlock block;
+    Board board;
+    std::vector<std::vector<uint8_t>> indices(count);
+    std::array<uint64_t, 256> frequencies{};
+    for (size_t g = 0; g < count; ++g) {
+        board.loadFen(startingPositionFen);
+        std::istringstream tokens(games[first + g]);
+        std::string token;
+        while (tokens >> token) {
+            std::vector<Move> moves = board.generateLegalMoves();
+            int index = findMoveIndex(moves, token);
+            if (index < 0 || index > 255) {
+                ++block.truncatedGames;
+                break;
+            }
+            indices[g].push_back((uint8_t)index);
+            ++frequencies[index];
+            board.applyMove(moves[index]);
+        }
+        block.moveCount += indices[g].size();
+    }
+
+    MoveIndexCode code = MoveIndexCode::build(frequencies);
+    std::vector<uint8_t>& out = block.bytes;
+    out.insert(out.end(), code.lengths.begin(), code.lengths.end());
+    for (const auto& game : indices) {
+        writeVarint(out, game.size());
+    }
+
+    std::vector<uint8_t> payload;
+    uint64_t bitBuffer = 0;
+    int bitCount = 0;
+    for (const auto& game : indices) {
+        for (uint8_t index : game) {
+            code.write(payload, bitBuffer, bitCount, index);
+        }
+    }
+    if (bitCount > 0) payload.push_back(uint8_t(bitBuffer << (8 - bitCount)));
+    writeVarint(out, payload.size());
+    out.insert(out.end(), payload.begin(), payload.end());
+    return block;
+}
+
+// Replays the games of a block straight into a Board, calling onMove(game, board, move)
+// after every move. With onlyGame set, earlier games are skipped without replaying them.
+template <typename OnMove>
+void decodeArchiveBlock(const std::vector<uint8_t>& bytes, uint32_t gameCount, OnMove&& onMove, int onlyGame = -1) {
+    const uint8_t* data = bytes.data();
+    const uint8_t* end = data + bytes.size();
+    if (bytes.size() < 256) throw std::runtime_error("Truncated archive block");
+    MoveIndexCode code = MoveIndexCode::fromLengths(data);
+    data += 256;
+
+    std::vector<uint64_t> moveCounts(gameCount);
+    for (uint64_t& moves : moveCounts) moves = readVarint(data, end);
+    uint64_t payloadSize = readVarint(data, end);
+    if (payloadSize > uint64_t(end - data)) throw std::runtime_error("Truncated archive block");
+
+    size_t bitPosition = 0;
+    size_t sizeInBits = payloadSize * 8;
+    Board board;
+    for (int g = 0; g < (int)gameCount; ++g) {
+        bool replay = onlyGame < 0 || g == onlyGame;
+        if (replay) board.loadFen(startingPositionFen);
+        for (uint64_t i = 0; i < moveCounts[g]; ++i) {
+            int index = code.read(data, sizeInBits, bitPosition);
+            if (!replay) continue;
+            std::vector<Move> moves = board.generateLegalMoves();
+            if (index >= (int)moves.size()) throw std::runtime_error("Archive move index out of range");
+            board.applyMove(moves[index]);
+            onMove(g, board, moves[index]);
+        }
+        if (g == onlyGame) return;
+    }
+}
+
+class ArchiveReader {
+public:
+    // Throws std::runtime_error if the file is not an archive or its header or block index
+    // does not fit the file.
+    explicit ArchiveReader(const std::string& path) : in(path, std::ios::binary) {
+        if (!in) throw std::runtime_error("Cannot open " + path);
+        in.seekg(0, std::ios::end);
+        uint64_t fileSize = (uint64_t)in.tellg();
+        in.seekg(0);
+
+        uint8_t header[24];
+        if (!in.read((char*)header, sizeof(header)) || !std::equal(archiveMagic, archiveMagic + 4, (const char*)header)) {
+            throw std::runtime_error("Not a game archive: " + path);
+        }
+        uint32_t blockCount = (uint32_t)readLittleEndian(header + 4, 4);
+        gameCount = readLittleEndian(header + 8, 8);
+        uint64_t indexOffset = readLittleEndian(header + 16, 8);
+        // The block index is the last thing in the file.
+        if (indexOffset < sizeof(header) || indexOffset > fileSize || fileSize - indexOffset != uint64_t(blockCount) * 24) {
+            throw std::runtime_error("Corrupt archive header: " + path);
+        }
+
+        std::vector<uint8_t> index(size_t(blockCount) * 24);
+        in.seekg(indexOffset);
+        if (!in.read((char*)index.data(), index.size())) {
+            throw std::runtime_error("Cannot read the block index of " + path);
+        }
+        uint64_t nextGame = 0;
+        for (uint32_t i = 0; i < blockCount; ++i) {
+            const uint8_t* entry = index.data() + i * 24;
+            ArchiveBlockInfo block = { readLittleEndian(entry, 8), (uint32_t)readLittleEndian(entry + 8, 4),
+                (uint32_t)readLittleEndian(entry + 12, 4), readLittleEndian(entry + 16, 8) };
+            if (block.offset < sizeof(header) || block.offset > indexOffset || block.size > indexOffset - block.offset ||
+                block.gameCount == 0 || block.gameCount > archiveGamesPerBlock || block.firstGame != nextGame) {
+                throw std::runtime_error("Corrupt block index entry " + std::to_string(i) + " in " + path);
+            }
+            nextGame += block.gameCount;
+            blocks.push_back(block);
+        }
+        if (nextGame != gameCount) {
+            throw std::runtime_error("Block index does not match the game count in " + path);
+        }
+    }
+
+    uint64_t getGameCount() const { return gameCount; }
+    const std::vector<ArchiveBlockInfo>& getBlocks() const { return blocks; }
+
+    std::vector<uint8_t> readBlock(size_t block) {
+        std::vector<uint8_t> bytes(blocks[block].size);
+        in.seekg(blocks[block].offset);
+        if (!in.read((char*)bytes.data(), bytes.size())) {
+            throw std::runtime_error("Cannot read archive block " + std::to_string(block));
+        }
+        return bytes;
+    }
+
+    // Moves of game n (0-based), found through the block index.
+    std::vector<Move> readGame(uint64_t n) {
+        auto it = std::upper_bound(blocks.begin(), blocks.end(), n,
+            [](uint64_t game, const ArchiveBlockInfo& info) { return game < info.firstGame; });
+        if (it == blocks.begin() || n >= gameCount) throw std::out_of_range("No such game in archive");
+        --it;
+        std::vector<Move> moves;
+        decodeArchiveBlock(readBlock(it - blocks.begin()), it->gameCount,
+            [&](int, Board&, const Move& move) { moves.push_back(move); }, int(n - it->firstGame));
+        return moves;
+    }
+
+private:
+    std::ifstream in;
+    uint64_t gameCount = 0;
+    std::vector<ArchiveBlockInfo> blocks;
+};
+
+int parseThreadCount(int argc, char** argv, int firstOption) {
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = firstOption; i + 1 < argc; i += 2) {
+        if (std::string(argv[i]) == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+    }
+    return threadCount;
+}
+
+// --archive-encode <games file> <archive> [--threads n]
+int runArchiveEncodeMode(int argc, char** argv) {
+    int threadCount = parseThreadCount(argc, argv, 4);
+    std::ifstream in(argv[2]);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[2] << "\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::ofstream out(argv[3], std::ios::binary);
+    std::vector<uint8_t> header(archiveMagic, archiveMagic + 4);
+    header.resize(24);
+    out.write((const char*)header.data(), header.size());
+
+    std::vector<ArchiveBlockInfo> blocks;
+    uint64_t offset = header.size();
+    uint64_t gameCount = 0;
+    uint64_t moveCount = 0;
+    int truncatedGames = 0;
+    // The input is streamed one wave (threadCount blocks) at a time; the blocks of a wave are
+    // encoded in parallel and written in order, so memory stays bounded by the wave size.
+    const size_t waveGames = size_t(threadCount) * archiveGamesPerBlock;
+    std::vector<std::string> games;
+    std::string line;
+    while (in) {
+        games.clear();
+        while (games.size() < waveGames && std::getline(in, line)) {
+            if (!line.empty() && line[0] != '#') games.push_back(line);
+        }
+        if (games.empty()) break;
+
+        std::vector<std::future<EncodedArchiveBlock>> encoding;
+        for (size_t first = 0; first < games.size(); first += archiveGamesPerBlock) {
+            size_t count = std::min<size_t>(archiveGamesPerBlock, games.size() - first);
+            encoding.push_back(std::async(std::launch::async, [&games, first, count]() {
+                return encodeArchiveBlock(games, first, count);
+            }));
+        }
+        for (size_t i = 0; i < encoding.size(); ++i) {
+            EncodedArchiveBlock block = encoding[i].get();
+            uint32_t count = (uint32_t)std::min<size_t>(archiveGamesPerBlock, games.size() - i * archiveGamesPerBlock);
+            blocks.push_back({ offset, (uint32_t)block.bytes.size(), count, gameCount });
+            out.write((const char*)block.bytes.data(), block.bytes.size());
+            offset += block.bytes.size();
+            gameCount += count;
+            moveCount += block.moveCount;
+            truncatedGames += block.truncatedGames;
+        }
+    }
+
+    std::vector<uint8_t> index;
+    for (const ArchiveBlockInfo& block : blocks) {
+        writeLittleEndian(index, block.offset, 8);
+        writeLittleEndian(index, block.size, 4);
+        writeLittleEndian(index, block.gameCount, 4);
+        writeLittleEndian(index, block.firstGame, 8);
+    }
+    out.write((const char*)index.data(), index.size());
+
+    header.resize(4);
+    writeLittleEndian(header, blocks.size(), 4);
+    writeLittleEndian(header, gameCount, 8);
+    writeLittleEndian(header, offset, 8);
+    out.seekp(0);
+    out.write((const char*)header.data(), header.size());
+    out.close();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t totalBytes = offset + index.size();
+    std::cout << "games=" << gameCount << " moves=" << moveCount << " truncated=" << truncatedGames
+        << " bytes=" << totalBytes << " bytes/move=" << (moveCount ? double(totalBytes) / moveCount : 0.0)
+        << " threads=" << threadCount << " seconds=" << seconds << " games/sec=" << gameCount / seconds << "\n";
+    return 0;
+}
+
+// --archive-decode <archive> [--threads n]: full parallel replay plus random access timing
+int runArchiveDecodeMode(int argc, char** argv) {
+    try {
+        std::string path = argv[2];
+        int threadCount = parseThreadCount(argc, argv, 3);
+        ArchiveReader reader(path);
+        const std::vector<ArchiveBlockInfo>& blocks = reader.getBlocks();
+
+        std::atomic<size_t> nextBlock{ 0 };
+        std::atomic<uint64_t> moveCount{ 0 };
+        std::atomic<uint64_t> checksum{ 0 };
+        // The first error stops the other workers; it is reported once they have joined.
+        std::mutex errorMutex;
+        std::string firstError;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threadCount; ++t) {
+            workers.emplace_back([&]() {
+                size_t block = 0;
+                try {
+                    ArchiveReader threadReader(path);
+                    while ((block = nextBlock.fetch_add(1)) < blocks.size()) {
+                        uint64_t moves = 0, hash = 0;
+                        decodeArchiveBlock(threadReader.readBlock(block), blocks[block].gameCount,
+                            [&](int, Board& board, const Move&) {
+                                ++moves;
+                                hash += board.getPositionHash();
+                            });
+                        moveCount += moves;
+                        checksum += hash;
+                    }
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (firstError.empty()) firstError = "Block " + std::to_string(block) + ": " + e.what();
+                    nextBlock = blocks.size();
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        if (!firstError.empty()) {
+            std::cerr << firstError << "\n";
+            return 1;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> latencies;
+        std::mt19937_64 random(12345);
+        for (int i = 0; i < 200 && reader.getGameCount() > 0; ++i) {
+            uint64_t game = random() % reader.getGameCount();
+            auto accessStart = std::chrono::steady_clock::now();
+            reader.readGame(game);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - accessStart).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        std::cout << "games=" << reader.getGameCount() << " moves=" << moveCount.load() << " threads=" << threadCount
+            << " seconds=" << seconds << " games/sec=" << reader.getGameCount() / seconds
+            << " checksum=" << std::hex << checksum.load() << std::dec << "\n";
+        if (!latencies.empty()) {
+            std::cout << "random access: p50_us=" << latencies[latencies.size() / 2]
+                << " p99_us=" << latencies[latencies.size() * 99 / 100] << " max_us=" << latencies.back() << "\n";
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// --archive-game <archive> <n>: prints game n (1-based) in coordinate notation
+int runArchiveGameMode(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: --archive-game <archive> <N>\n";
+        return 1;
+    }
+    try {
+        ArchiveReader reader(argv[2]);
+        char* end = nullptr;
+        uint64_t game = std::strtoull(argv[3], &end, 10);
+        if (*end != '\0' || game == 0 || game > reader.getGameCount()) {
+            std::cerr << "Game " << argv[3] << " is out of range; the archive holds games 1 to "
+                << reader.getGameCount() << "\n";
+            return 1;
+        }
+        for (const Move& move : reader.readGame(game - 1)) {
+            std::cout << toCoordinateNotation(move) << " ";
+        }
+        std::cout << "\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Position index: which games reached a position (run with --index-build / --index-query)
+//
+// Every position of every game is keyed by BasicBoard::getPositionHash() and deduplicated.
+// The file is a header, one 24-byte record per distinct position sorted by hash, then the
+// postings: 1-based game numbers, ascending, one run per record. It is stored in host
+// (little-endian) byte order so queries binary-search the mapped file in place.
+
+const char indexMagic[4] = { 'C', 'R', 'X', '1' };
+
+struct PositionIndexHeader {
+    char magic[4];
+    uint32_t gameCount;
+    uint64_t recordCount;
+    uint64_t postingCount;
+};
+
+struct PositionIndexRecord {
+    uint64_t hash;
+    uint64_t firstPosting;
+    uint32_t gameCount;
+    // Earliest ply at which any game reached the position
+    uint32_t firstPly;
+};
+static_assert(sizeof(PositionIndexHeader) == 24 && sizeof(PositionIndexRecord) == 24,
+    "The index is written and read as raw structs");
+
+#ifdef _WIN32
+// windows.h clashes with raylib (Rectangle, CloseWindow, DrawText, ...), so the few calls
+// needed to map a file are declared here.
+extern "C" {
+    __declspec(dllimport) void* __stdcall CreateFileA(const char*, unsigned long, unsigned long, void*, unsigned long, unsigned long, void*);
+    __declspec(dllimport) int __stdcall GetFileSizeEx(void*, long long*);
+    __declspec(dllimport) void* __stdcall CreateFileMappingA(void*, void*, unsigned long, unsigned long, unsigned long, const char*);
+    __declspec(dllimport) void* __stdcall MapViewOfFile(void*, unsigned long, unsigned long, unsigned long, size_t);
+    __declspec(dllimport) int __stdcall UnmapViewOfFile(const void*);
+    __declspec(dllimport) int __stdcall CloseHandle(void*);
+}
+#endif
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        const unsigned long genericRead = 0x80000000, fileShareRead = 1, openExisting = 3, pageReadOnly = 2, fileMapRead = 4;
+        void* file = CreateFileA(path.c_str(), genericRead, fileShareRead, nullptr, openExisting, 0, nullptr);
+        if (file == (void*)-1) throw std::runtime_error("Cannot open " + path);
+        long long fileSize = 0;
+        GetFileSizeEx(file, &fileSize);
+        bytes = size_t(fileSize);
+        if (bytes > 0) {
+            mapping = CreateFileMappingA(file, nullptr, pageReadOnly, 0, 0, nullptr);
+            if (mapping) view = MapViewOfFile(mapping, fileMapRead, 0, 0, 0);
+        }
+        CloseHandle(file);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) throw std::runtime_error("Cannot open " + path);
+        struct stat info;
+        if (fstat(file, &info) == 0) bytes = size_t(info.st_size);
+        if (bytes > 0) {
+            view = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, file, 0);
+            if (view == MAP_FAILED) view = nullptr;
+        }
+        close(file);
+#endif
+        if (bytes > 0 && !view) {
+            unmap();
+            throw std::runtime_error("Cannot map " + path);
+        }
+    }
+
+    ~MappedFile() { unmap(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(view); }
+    size_t size() const { return bytes; }
+
+private:
+    void unmap() {
+#ifdef _WIN32
+        if (view) UnmapViewOfFile(view);
+        if (mapping) CloseHandle(mapping);
+        mapping = nullptr;
+#else
+        if (view) munmap(view, bytes);
+#endif
+        view = nullptr;
+    }
+
+    void* view = nullptr;
+#ifdef _WIN32
+    void* mapping = nullptr;
+#endif
+    size_t bytes = 0;
+};
+
+class PositionIndex {
+public:
+    explicit PositionIndex(const std::string& path) : file(path) {
+        if (file.size() < sizeof(PositionIndexHeader) || !std::equal(indexMagic, indexMagic + 4, (const char*)file.data())) {
+            throw std::runtime_error("Not a position index: " + path);
+        }
+        const PositionIndexHeader& header = *reinterpret_cast<const PositionIndexHeader*>(file.data());
+        gameCount = header.gameCount;
+        recordCount = header.recordCount;
+        if (file.size() != sizeof(PositionIndexHeader) + recordCount * sizeof(PositionIndexRecord) + header.postingCount * sizeof(uint32_t)) {
+            throw std::runtime_error("Truncated position index: " + path);
+        }
+        records = reinterpret_cast<const PositionIndexRecord*>(file.data() + sizeof(PositionIndexHeader));
+        postings = reinterpret_cast<const uint32_t*>(records + recordCount);
+    }
+
+    // Binary search over the mapped records; returns nullptr if no game reached the position.
+    const PositionIndexRecord* find(uint64_t hash) const {
+        const PositionIndexRecord* end = records + recordCount;
+        const PositionIndexRecord* it = std::lower_bound(records, end, hash,
+            [](const PositionIndexRecord& record, uint64_t value) { return record.hash < value; });
+        return it != end && it->hash == hash ? it : nullptr;
+    }
+
+    // Points into the mapping; valid as long as the index is.
+    std::span<const uint32_t> gamesOf(const PositionIndexRecord& record) const {
+        return { postings + record.firstPosting, record.gameCount };
+    }
+
+    uint32_t getGameCount() const { return gameCount; }
+    uint64_t getRecordCount() const { return recordCount; }
+
+private:
+    MappedFile file;
+    uint32_t gameCount = 0;
+    uint64_t recordCount = 0;
+    const PositionIndexRecord* records = nullptr;
+    const uint32_t* postings = nullptr;
+};
+
+struct IndexEntry {
+    uint64_t hash;
+    uint32_t game;
+    uint32_t ply;
+};
+
+// --index-build <games file> <index> [--threads n]
+int runIndexBuildMode(int argc, char** argv) {
+    int threadCount = parseThreadCount(argc, argv, 4);
+    std::vector<std::string> games;
+    std::ifstream in(argv[2]);
+    if (!in) {
+        std::cerr << "Cannot open " << argv[2] << "\n";
+        return 1;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line[0] != '#') games.push_back(line);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    // Phase 1: each worker replays a contiguous range of games and files every (position, game)
+    // pair into one bucket per hash range. Phase 2 then sorts each hash range on its own, and
+    // the ranges concatenated in order form the sorted table.
+    const int partitionCount = threadCount;
+    auto partitionOf = [&](uint64_t hash) { return int(((hash >> 32) * uint64_t(partitionCount)) >> 32); };
+    std::vector<std::vector<std::vector<IndexEntry>>> buckets(threadCount, std::vector<std::vector<IndexEntry>>(partitionCount));
+    std::atomic<uint64_t> positionCount{ 0 };
+    std::atomic<int> truncatedGames{ 0 };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            Board board;
+            std::vector<IndexEntry> gameEntries;
+            size_t first = games.size() * t / threadCount;
+            size_t last = games.size() * (t + 1) / threadCount;
+            for (size_t g = first; g < last; ++g) {
+                uint32_t game = uint32_t(g + 1);
+                board.loadFen(startingPositionFen);
+                gameEntries.clear();
+                gameEntries.push_back({ board.getPositionHash(), game, 0 });
+
+                std::istringstream tokens(games[g]);
+                std::string text;
+                while (tokens >> text) {
+                    Move move{};
+                    if (!parseCoordinateMove(board, text, move)) {
+                        ++truncatedGames;
+                        break;
+                    }
+                    board.applyMove(move);
+                    gameEntries.push_back({ board.getPositionHash(), game, uint32_t(gameEntries.size()) });
+                }
+                positionCount += gameEntries.size();
+
+                // A game is posted once per position, at the first ply it got there.
+                std::sort(gameEntries.begin(), gameEntries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+                    return a.hash != b.hash ? a.hash < b.hash : a.ply < b.ply;
+                });
+                auto end = std::unique(gameEntries.begin(), gameEntries.end(),
+                    [](const IndexEntry& a, const IndexEntry& b) { return a.hash == b.hash; });
+                for (auto it = gameEntries.begin(); it != end; ++it) {
+                    buckets[t][partitionOf(it->hash)].push_back(*it);
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    struct IndexPartition {
+        std::vector<PositionIndexRecord> records;
+        std::vector<uint32_t> postings;
+    };
+    std::vector<IndexPartition> partitions(partitionCount);
+    workers.clear();
+    for (int p = 0; p < partitionCount; ++p) {
+        workers.emplace_back([&, p]() {
+            std::vector<IndexEntry> entries;
+            for (int t = 0; t < threadCount; ++t) {
+                entries.insert(entries.end(), buckets[t][p].begin(), buckets[t][p].end());
+                std::vector<IndexEntry>().swap(buckets[t][p]);
+            }
+            std::sort(entries.begin(), entries.end(), [](const IndexEntry& a, const IndexEntry& b) {
+                return a.hash != b.hash ? a.hash < b.hash : a.game < b.game;
+            });
+
+            IndexPartition& partition = partitions[p];
+            partition.postings.reserve(entries.size());
+            for (size_t i = 0; i < entries.size();) {
+                PositionIndexRecord record{ entries[i].hash, partition.postings.size(), 0, UINT32_MAX };
+                for (; i < entries.size() && entries[i].hash == record.hash; ++i) {
+                    partition.postings.push_back(entries[i].game);
+                    record.firstPly = std::min(record.firstPly, entries[i].ply);
+                }
+                record.gameCount = uint32_t(partition.postings.size() - record.firstPosting);
+                partition.records.push_back(record);
+            }
+        });
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+
+    PositionIndexHeader header{ { indexMagic[0], indexMagic[1], indexMagic[2], indexMagic[3] }, uint32_t(games.size()), 0, 0 };
+    for (IndexPartition& partition : partitions) {
+        for (PositionIndexRecord& record : partition.records) record.firstPosting += header.postingCount;
+        header.recordCount += partition.records.size();
+        header.postingCount += partition.postings.size();
+    }
+    std::ofstream out(argv[3], std::ios::binary);
+    out.write((const char*)&header, sizeof(header));
+    for (const IndexPartition& partition : partitions) {
+        out.write((const char*)partition.records.data(), partition.records.size() * sizeof(PositionIndexRecord));
+    }
+    for (const IndexPartition& partition : partitions) {
+        out.write((const char*)partition.postings.data(), partition.postings.size() * sizeof(uint32_t));
+    }
+    out.close();
+    if (!out) {
+        std::cerr << "Cannot write " << argv[3] << "\n";
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t totalBytes = sizeof(header) + header.recordCount * sizeof(PositionIndexRecord) + header.postingCount * sizeof(uint32_t);
+    std::cout << "games=" << games.size() << " positions=" << positionCount.load() << " distinct=" << header.recordCount
+        << " postings=" << header.postingCount << " truncated=" << truncatedGames.load() << " bytes=" << totalBytes
+        << " threads=" << threadCount << " seconds=" << seconds << " games/sec=" << games.size() / seconds << "\n";
+    return 0;
+}
+
+// --index-query <index> <FEN>: prints the numbers of the games that reached the position
+int runIndexQueryMode(int argc, char** argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: --index-query <index> <FEN>\n";
+        return 1;
+    }
+    try {
+        PositionIndex index(argv[2]);
+        Board board;
+        board.loadFen(argv[3]);
+
+        auto start = std::chrono::steady_clock::now();
+        const PositionIndexRecord* record = index.find(board.getPositionHash());
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (!record) {
+            std::cout << "games=0 lookup_us=" << micros << "\n";
+            return 0;
+        }
+        std::cout << "games=" << record->gameCount << " first_ply=" << record->firstPly << " lookup_us=" << micros << "\n";
+        for (uint32_t game : index.gamesOf(*record)) {
+            std::cout << game << " ";
+        }
+        std::cout << "\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+// Many concurrent games in one process (run with --serve-bench)
+//
+// Each game is a Board in a pooled arena. A load generator sends move requests through a
+// bounded queue to a small worker pool; games are spread over a fixed set of shard locks,
+// so two workers never touch the same game at once.
+
+const Board& startingBoard() {
+    static const Board board = []() {
+        Board start;
+        start.loadFen(startingPositionFen);
+        return start;
+    }();
+    return board;
+}
+
+// Fixed pool of boards. A finished game's slot is reset in place and reused, so a new
+// game does not allocate.
+class GameArena {
+public:
+    explicit GameArena(size_t capacity) : slots(capacity, startingBoard()) {
+        freeSlots.reserve(capacity);
+        for (size_t i = capacity; i-- > 0;) freeSlots.push_back((uint32_t)i);
+    }
+
+    uint32_t acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (freeSlots.empty()) throw std::runtime_error("Game arena is full");
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    // The caller must own the slot (hold its game's shard lock).
+    void release(uint32_t slot) {
+        slots[slot] = startingBoard();
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.push_back(slot);
+    }
+
+    Board& get(uint32_t slot) { return slots[slot]; }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(*this) + freeSlots.capacity() * sizeof(uint32_t);
+        for (const Board& board : slots) bytes += board.memoryUsage();
+        return bytes;
+    }
+
+private:
+    std::vector<Board> slots;
+    std::vector<uint32_t> freeSlots;
+    std::mutex mutex;
+};
+
+struct MoveRequest {
+    uint32_t game;
+    // Picks the move as choice % number of legal moves, so the client needs no board.
+    uint32_t choice;
+    std::chrono::steady_clock::time_point sent;
+};
+
+// Bounded so the producer is slowed down instead of queueing without limit. Request needs a
+// steady_clock time_point named sent.
+template <typename Request>
+class RequestQueue {
+public:
+    explicit RequestQueue(size_t capacity) : capacity(capacity) {}
+
+    // Stamps request.sent once there is room, so time spent blocked here is not counted as latency.
+    void push(Request request) {
+        std::unique_lock<std::mutex> lock(mutex);
+        spaceFreed.wait(lock, [&]() { return pending.size() < capacity; });
+        request.sent = std::chrono::steady_clock::now();
+        pending.push_back(std::move(request));
+        workReady.notify_one();
+    }
+
+    // Returns false once close() has been called and nothing is left.
+    bool pop(Request& request) {
+        std::unique_lock<std::mutex> lock(mutex);
+        workReady.wait(lock, [&]() { return !pending.empty() || closed; });
+        if (pending.empty()) return false;
+        request = std::move(pending.front());
+        pending.pop_front();
+        spaceFreed.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        workReady.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable spaceFreed;
+    std::deque<Request> pending;
+    size_t capacity;
+    bool closed = false;
+};
+
+const int serveShardCount = 64;
+
+// Runs one load level: gameCount live games and moveCount requests spread over them at random.
+void runServeBenchLevel(uint32_t gameCount, uint64_t moveCount, int threadCount) {
+    GameArena arena(gameCount);
+    std::vector<uint32_t> gameSlots(gameCount);
+    for (uint32_t& slot : gameSlots) slot = arena.acquire();
+    std::vector<std::mutex> shardLocks(serveShardCount);
+
+    RequestQueue<MoveRequest> queue(4 * threadCount);
+    std::vector<std::vector<double>> latencies(threadCount);
+    std::atomic<uint64_t> gamesRestarted{ 0 };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&, t]() {
+            std::vector<double>& latency = latencies[t];
+            latency.reserve(moveCount / threadCount + 1);
+            MoveRequest request;
+            while (queue.pop(request)) {
+                {
+                    std::lock_guard<std::mutex> lock(shardLocks[request.game % serveShardCount]);
+                    Board& board = arena.get(gameSlots[request.game]);
+                    std::vector<Move> moves = board.generateLegalMoves();
+                    if (moves.empty() || board.isThreefoldRepetition() || board.isFiftyMoveRuleDraw()) {
+                        // Game over: hand the slot back and start a fresh game under the same id.
+                        arena.release(gameSlots[request.game]);
+                        gameSlots[request.game] = arena.acquire();
+                        ++gamesRestarted;
+                    }
+                    else {
+                        board.applyMove(moves[request.choice % moves.size()]);
+                    }
+                }
+                latency.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - request.sent).count());
+            }
+        });
+    }
+
+    std::mt19937 random(gameCount);
+    for (uint64_t i = 0; i < moveCount; ++i) {
+        queue.push({ uint32_t(random() % gameCount), uint32_t(random()), {} });
+    }
+    queue.close();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const std::vector<double>& latency : latencies) all.insert(all.end(), latency.begin(), latency.end());
+    std::sort(all.begin(), all.end());
+    auto percentile = [&](double p) { return all.empty() ? 0.0 : all[std::min(all.size() - 1, size_t(p * all.size()))]; };
+
+    size_t bytes = arena.memoryUsage() + gameSlots.capacity() * sizeof(uint32_t) + shardLocks.size() * sizeof(std::mutex);
+    std::cout << "games=" << gameCount << " moves=" << moveCount << " restarts=" << gamesRestarted.load()
+        << " threads=" << threadCount << " seconds=" << seconds << " moves/sec=" << moveCount / seconds
+        << " p50_us=" << percentile(0.5) << " p99_us=" << percentile(0.99)
+        << " bytes/game=" << double(bytes) / gameCount << "\n";
+}
+
+// --serve-bench [--games 1000,10000,100000] [--moves n] [--threads n]
+int runServeBenchMode(int argc, char** argv) {
+    std::vector<uint32_t> gameCounts = { 1000, 10000, 100000 };
+    uint64_t moveCount = 200000;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+        else if (flag == "--moves") moveCount = std::stoull(argv[i + 1]);
+        else if (flag == "--games") {
+            gameCounts.clear();
+            std::istringstream list(argv[i + 1]);
+            std::string count;
+            while (std::getline(list, count, ',')) gameCounts.push_back((uint32_t)std::max(1ul, std::stoul(count)));
+        }
+    }
+    for (uint32_t gameCount : gameCounts) {
+        runServeBenchLevel(gameCount, moveCount, threadCount);
+    }
+    return 0;
+}
+
+#ifdef __linux__
+// Game server over a local socket (run with --serve, load it with --serve-load)
+//
+// One epoll loop accepts clients and reads newline-terminated commands; moves go through a
+// RequestQueue to the worker pool, which applies them to the arena under the game's shard
+// lock and hands the reply back to the loop through an eventfd. Protocol, one line each way:
+//   new             -> new <game> | full
+//   <game> <move>   -> <game> ok | <game> illegal      (move as e2e4 or e7e8q)
+//   free <game>     -> <game> freed | <game> illegal
+//   stats           -> stats games=<n> bytes=<n> bytes/game=<x> moves=<n> mean_commit_us=<x>
+// A game belongs to the connection that created it and is freed when that connection closes.
+// Send the next command for a game only after its reply; replies for different games can
+// arrive out of order.
+
+const char* defaultServeSocketPath = "/tmp/chessraylib.sock";
+
+struct ServeRequest {
+    // 0 for requests nobody waits on (games freed because their connection closed).
+    uint64_t connection;
+    uint32_t game;
+    bool release;
+    std::string move;
+    std::chrono::steady_clock::time_point sent;
+};
+
+class GameServer {
+public:
+    GameServer(uint32_t capacity, int threadCount)
+        : arena(capacity), owners(capacity, 0), shardLocks(serveShardCount), queue(64 * threadCount),
+        threadCount(threadCount) {
+    }
+
+    // Listens on the Unix socket (if unixPath is not empty) and on 127.0.0.1:tcpPort (if not 0),
+    // and serves until SIGINT or SIGTERM.
+    int run(const std::string& unixPath, int tcpPort) {
+        // Blocked before the workers start so that only the signalfd sees them.
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigprocmask(SIG_BLOCK, &signals, nullptr);
+
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        int signalFd = signalfd(-1, &signals, SFD_NONBLOCK);
+        watch(wakeFd, wakeId, EPOLLIN);
+        watch(signalFd, signalId, EPOLLIN);
+
+        if (!unixPath.empty()) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (unixPath.size() >= sizeof(address.sun_path)) {
+                std::cerr << "Socket path too long: " << unixPath << "\n";
+                return 1;
+            }
+            std::copy(unixPath.begin(), unixPath.end(), address.sun_path);
+            unlink(unixPath.c_str());
+            unixListenFd = listenOn(AF_UNIX, (const sockaddr*)&address, sizeof(address));
+            if (unixListenFd < 0) {
+                std::cerr << "Cannot listen on " << unixPath << "\n";
+                return 1;
+            }
+            watch(unixListenFd, unixListenerId, EPOLLIN);
+            std::cout << "listening on " << unixPath << "\n";
+        }
+        if (tcpPort != 0) {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons((uint16_t)tcpPort);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            tcpListenFd = listenOn(AF_INET, (const sockaddr*)&address, sizeof(address));
+            if (tcpListenFd < 0) {
+                std::cerr << "Cannot listen on 127.0.0.1:" << tcpPort << "\n";
+                return 1;
+            }
+            watch(tcpListenFd, tcpListenerId, EPOLLIN);
+            std::cout << "listening on 127.0.0.1:" << tcpPort << "\n";
+        }
+        std::cout << "games=" << owners.size() << " threads=" << threadCount << std::endl;
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threadCount; ++t) {
+            workers.emplace_back([this]() { serveRequests(); });
+        }
+
+        bool running = true;
+        std::vector<epoll_event> events(256);
+        while (running) {
+            int ready = epoll_wait(epollFd, events.data(), (int)events.size(), -1);
+            if (ready < 0 && errno != EINTR) break;
+            for (int i = 0; i < ready; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == signalId) running = false;
+                else if (id == wakeId) deliverReplies();
+                else if (id == unixListenerId) acceptClients(unixListenFd);
+                else if (id == tcpListenerId) acceptClients(tcpListenFd);
+                else if (events[i].events & (EPOLLERR | EPOLLHUP)) closeClient(id);
+                else {
+                    if (events[i].events & EPOLLOUT) flush(id);
+                    if (events[i].events & EPOLLIN) readClient(id);
+                }
+            }
+        }
+
+        queue.close();
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        for (auto& [id, client] : clients) close(client.fd);
+        for (int fd : { unixListenFd, tcpListenFd, signalFd, wakeFd, epollFd }) {
+            if (fd >= 0) close(fd);
+        }
+        if (!unixPath.empty()) unlink(unixPath.c_str());
+        std::cout << "moves=" << committedMoves.load() << "\n";
+        return 0;
+    }
+
+private:
+    struct Client {
+        int fd = -1;
+        std::string input;
+        std::string output;
+        bool writeWatched = false;
+    };
+
+    // epoll ids; clients are numbered from firstClientId so a reused fd never gets an old reply.
+    static constexpr uint64_t wakeId = 1, signalId = 2, unixListenerId = 3, tcpListenerId = 4, firstClientId = 5;
+    static constexpr size_t maxLineLength = 256;
+
+    GameArena arena;
+    // Owning connection per arena slot, 0 when free. Only the event loop touches it.
+    std::vector<uint64_t> owners;
+    std::vector<std::mutex> shardLocks;
+    RequestQueue<ServeRequest> queue;
+    int threadCount;
+    std::atomic<uint64_t> committedMoves{ 0 };
+    // Queued to applied, summed over committed moves.
+    std::atomic<uint64_t> commitNanoseconds{ 0 };
+
+    int epollFd = -1, wakeFd = -1, unixListenFd = -1, tcpListenFd = -1;
+    std::map<uint64_t, Client> clients;
+    uint64_t nextClientId = firstClientId;
+
+    std::mutex replyMutex;
+    std::vector<std::pair<uint64_t, std::string>> replies;
+
+    void watch(int fd, uint64_t id, uint32_t events, int operation = EPOLL_CTL_ADD) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, operation, fd, &event);
+    }
+
+    static int listenOn(int family, const sockaddr* address, socklen_t length) {
+        int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        int reuse = 1;
+        if (family == AF_INET) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, address, length) < 0 || listen(fd, SOMAXCONN) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void acceptClients(int listenFd) {
+        int fd;
+        while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            uint64_t id = nextClientId++;
+            clients[id].fd = fd;
+            watch(fd, id, EPOLLIN);
+        }
+    }
+
+    void readClient(uint64_t id) {
+        auto it = clients.find(id);
+        if (it == clients.end()) return;
+        char buffer[65536];
+        ssize_t received = recv(it->second.fd, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            closeClient(id);
+            return;
+        }
+        if (received < 0) return;
+
+        std::string& input = it->second.input;
+        input.append(buffer, received);
+        size_t start = 0, end;
+        while ((end = input.find('\n', start)) != std::string::npos) {
+            std::string line = input.substr(start, end - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            handleLine(id, line);
+            start = end + 1;
+        }
+        input.erase(0, start);
+        if (input.size() > maxLineLength) {
+            closeClient(id);
+            return;
+        }
+        flush(id);
+    }
+
+    void handleLine(uint64_t id, const std::string& line) {
+        std::istringstream words(line);
+        std::string command, argument;
+        words >> command >> argument;
+        if (command.empty()) return;
+
+        if (command == "new") {
+            try {
+                uint32_t game = arena.acquire();
+                owners[game] = id;
+                reply(id, "new " + std::to_string(game));
+            }
+            catch (const std::runtime_error&) {
+                reply(id, "full");
+            }
+            return;
+        }
+        if (command == "stats") {
+            reply(id, statsLine());
+            return;
+        }
+
+        bool release = command == "free";
+        const std::string& gameText = release ? argument : command;
+        char* end = nullptr;
+        unsigned long game = std::strtoul(gameText.c_str(), &end, 10);
+        if (gameText.empty() || *end != '\0' || (!release && argument.empty())) {
+            reply(id, "error unknown command");
+            return;
+        }
+        if (game >= owners.size() || owners[game] != id) {
+            reply(id, gameText + " illegal");
+            return;
+        }
+        if (release) owners[game] = 0;
+        // Blocks while the workers are saturated, which holds back reading from every client.
+        queue.push({ id, uint32_t(game), release, release ? std::string() : argument, {} });
+    }
+
+    void serveRequests() {
+        ServeRequest request;
+        while (queue.pop(request)) {
+            std::string result;
+            {
+                std::lock_guard<std::mutex> lock(shardLocks[request.game % serveShardCount]);
+                if (request.release) {
+                    arena.release(request.game);
+                    result = "freed";
+                }
+                else {
+                    Board& board = arena.get(request.game);
+                    Move move{};
+                    if (parseCoordinateMove(board, request.move, move)) {
+                        board.applyMove(move);
+                        ++committedMoves;
+                        commitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - request.sent).count();
+                        result = "ok";
+                    }
+                    else {
+                        result = "illegal";
+                    }
+                }
+            }
+            if (request.connection == 0) continue;
+            {
+                std::lock_guard<std::mutex> lock(replyMutex);
+                replies.push_back({ request.connection, std::to_string(request.game) + " " + result });
+            }
+            // Wakes the event loop; a failed write means the counter is already non-zero.
+            uint64_t one = 1;
+            if (write(wakeFd, &one, sizeof(one)) < 0) continue;
+        }
+    }
+
+    void reply(uint64_t id, const std::string& text) {
+        auto it = clients.find(id);
+        if (it == clients.end()) return;
+        it->second.output += text;
+        it->second.output += '\n';
+    }
+
+    void deliverReplies() {
+        uint64_t count;
+        if (read(wakeFd, &count, sizeof(count)) < 0) return;
+        std::vector<std::pair<uint64_t, std::string>> ready;
+        {
+            std::lock_guard<std::mutex> lock(replyMutex);
+            ready.swap(replies);
+        }
+        // Replies for clients that have gone away are dropped here.
+        std::vector<uint64_t> touched;
+        for (const auto& [id, text] : ready) {
+            reply(id, text);
+            touched.push_back(id);
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (uint64_t id : touched) flush(id);
+    }
+
+    void flush(uint64_t id) {
+        auto it = clients.find(id);
+        if (it == clients.end()) return;
+        Client& client = it->second;
+        size_t written = 0;
+        while (written < client.output.size()) {
+            ssize_t sent = send(client.fd, client.output.data() + written, client.output.size() - written, MSG_NOSIGNAL);
+            if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (sent < 0) {
+                closeClient(id);
+                return;
+            }
+            written += sent;
+        }
+        client.output.erase(0, written);
+        // Only ask for EPOLLOUT while there is something left to send.
+        bool pending = !client.output.empty();
+        if (pending != client.writeWatched) {
+            client.writeWatched = pending;
+            watch(client.fd, id, pending ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+        }
+    }
+
+    void closeClient(uint64_t id) {
+        auto it = clients.find(id);
+        if (it == clients.end()) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.fd, nullptr);
+        close(it->second.fd);
+        clients.erase(it);
+        // A scan of the whole arena, but only once per disconnect.
+        for (uint32_t game = 0; game < owners.size(); ++game) {
+            if (owners[game] != id) continue;
+            owners[game] = 0;
+            queue.push({ 0, game, true, std::string(), {} });
+        }
+    }
+
+    // Memory of the games currently owned by a client, read with every shard locked.
+    std::string statsLine() {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (std::mutex& shard : shardLocks) locks.emplace_back(shard);
+        size_t games = 0, bytes = 0;
+        for (uint32_t game = 0; game < owners.size(); ++game) {
+            if (owners[game] == 0) continue;
+            ++games;
+            bytes += arena.get(game).memoryUsage() + sizeof(uint64_t);
+        }
+        uint64_t moves = committedMoves.load();
+        std::ostringstream line;
+        line << "stats games=" << games << " bytes=" << bytes
+            << " bytes/game=" << (games ? double(bytes) / games : 0.0) << " moves=" << moves
+            << " mean_commit_us=" << (moves ? commitNanoseconds.load() / 1000.0 / moves : 0.0);
+        return line.str();
+    }
+};
+
+// Connects to the server's Unix socket, or to 127.0.0.1:tcpPort when tcpPort is not 0.
+int connectToServer(const std::string& unixPath, int tcpPort) {
+    int fd;
+    if (tcpPort != 0) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)tcpPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (const sockaddr*)&address, sizeof(address)) == 0) {
+            int noDelay = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            return fd;
+        }
+    }
+    else {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (unixPath.size() >= sizeof(address.sun_path)) return -1;
+        std::copy(unixPath.begin(), unixPath.end(), address.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (const sockaddr*)&address, sizeof(address)) == 0) return fd;
+    }
+    if (fd >= 0) close(fd);
+    return -1;
+}
+
+// Blocking line reader for the load generator.
+class LineConnection {
+public:
+    explicit LineConnection(int fd) : fd(fd) {}
+    ~LineConnection() { close(fd); }
+
+    void send(const std::string& text) {
+        size_t written = 0;
+        while (written < text.size()) {
+            ssize_t sent = ::send(fd, text.data() + written, text.size() - written, MSG_NOSIGNAL);
+            if (sent <= 0) throw std::runtime_error("Lost connection to the server");
+            written += sent;
+        }
+    }
+
+    std::string readLine() {
+        size_t end;
+        while ((end = buffered.find('\n', start)) == std::string::npos) {
+            buffered.erase(0, start);
+            start = 0;
+            char chunk[65536];
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) throw std::runtime_error("Lost connection to the server");
+            buffered.append(chunk, received);
+        }
+        std::string line = buffered.substr(start, end - start);
+        start = end + 1;
+        return line;
+    }
+
+private:
+    int fd;
+    std::string buffered;
+    size_t start = 0;
+};
+
+struct ServeLoadResult {
+    uint64_t moves = 0;
+    uint64_t restarts = 0;
+    uint64_t rejected = 0;
+    std::vector<double> latencies;
+};
+
+// One connection's share of a load level: opens gameCount games, then keeps up to window
+// commands in flight, choosing each move from a mirror Board of the game. A finished game is
+// freed and replaced by a new one. Latency runs from send() returning to the reply being read.
+void runServeLoadConnection(LineConnection& connection, uint32_t gameCount, uint64_t moveCount, int window,
+    uint32_t seed, ServeLoadResult& result) {
+    struct LoadGame {
+        uint32_t id = 0;
+        Board mirror;
+        Move pending{};
+        std::chrono::steady_clock::time_point sent;
+    };
+    std::vector<LoadGame> games(gameCount);
+    std::map<uint32_t, uint32_t> gameById;
+    std::vector<uint32_t> idle;
+    // The server answers new in order, so ids go to the games in the order they were asked for.
+    std::deque<uint32_t> opening;
+    uint64_t inFlight = 0;
+
+    auto handleReply = [&](const std::string& line) {
+        --inFlight;
+        if (line.rfind("new ", 0) == 0 && !opening.empty()) {
+            uint32_t index = opening.front();
+            opening.pop_front();
+            games[index].id = (uint32_t)std::stoul(line.substr(4));
+            games[index].mirror.loadFen(startingPositionFen);
+            gameById[games[index].id] = index;
+            idle.push_back(index);
+            return;
+        }
+        size_t space = line.find(' ');
+        if (space == std::string::npos) throw std::runtime_error("Unexpected reply: " + line);
+        std::string word = line.substr(space + 1);
+        if (word == "freed") return;
+        auto it = gameById.find((uint32_t)std::strtoul(line.c_str(), nullptr, 10));
+        if (it == gameById.end() || (word != "ok" && word != "illegal")) {
+            throw std::runtime_error("Unexpected reply: " + line);
+        }
+        LoadGame& game = games[it->second];
+        if (word == "ok") {
+            game.mirror.applyMove(game.pending);
+            ++result.moves;
+        }
+        else {
+            ++result.rejected;
+        }
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - game.sent).count());
+        idle.push_back(it->second);
+    };
+
+    for (uint32_t first = 0; first < gameCount; first += window) {
+        uint32_t last = std::min<uint32_t>(gameCount, first + window);
+        std::string batch;
+        for (uint32_t index = first; index < last; ++index) {
+            batch += "new\n";
+            opening.push_back(index);
+            ++inFlight;
+        }
+        connection.send(batch);
+        while (inFlight > 0) handleReply(connection.readLine());
+    }
+
+    std::mt19937 random(seed);
+    result.latencies.reserve(moveCount);
+    uint64_t sentMoves = 0;
+    while (true) {
+        std::string batch;
+        std::vector<uint32_t> batchGames;
+        while (inFlight < (uint64_t)window && sentMoves < moveCount && !idle.empty()) {
+            size_t pick = random() % idle.size();
+            uint32_t index = idle[pick];
+            idle[pick] = idle.back();
+            idle.pop_back();
+
+            LoadGame& game = games[index];
+            std::vector<Move> moves = game.mirror.generateLegalMoves();
+            if (moves.empty() || game.mirror.isThreefoldRepetition() || game.mirror.isFiftyMoveRuleDraw()) {
+                batch += "free " + std::to_string(game.id) + "\nnew\n";
+                gameById.erase(game.id);
+                opening.push_back(index);
+                inFlight += 2;
+                ++result.restarts;
+                continue;
+            }
+            game.pending = moves[random() % moves.size()];
+            batch += std::to_string(game.id) + " " + toCoordinateNotation(game.pending) + "\n";
+            batchGames.push_back(index);
+            ++sentMoves;
+            ++inFlight;
+        }
+        if (!batch.empty()) {
+            connection.send(batch);
+            auto sent = std::chrono::steady_clock::now();
+            for (uint32_t index : batchGames) games[index].sent = sent;
+        }
+        if (inFlight == 0) break;
+        handleReply(connection.readLine());
+    }
+}
+
+// --serve [--unix path] [--port n] [--games capacity] [--threads n]
+int runServeMode(int argc, char** argv) {
+    std::string unixPath;
+    int tcpPort = 0;
+    uint32_t capacity = 200000;
+    int threadCount = std::max(1u, std::thread::hardware_concurrency());
+    try {
+        for (int i = 2; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            if (flag == "--unix") unixPath = argv[i + 1];
+            else if (flag == "--port") tcpPort = std::stoi(argv[i + 1]);
+            else if (flag == "--games") capacity = (uint32_t)std::max(1ul, std::stoul(argv[i + 1]));
+            else if (flag == "--threads") threadCount = std::max(1, std::stoi(argv[i + 1]));
+        }
+    }
+    catch (const std::exception&) {
+        std::cerr << "Usage: --serve [--unix path] [--port n] [--games capacity] [--threads n]\n";
+        return 1;
+    }
+    if (unixPath.empty() && tcpPort == 0) unixPath = defaultServeSocketPath;
+
+    GameServer server(capacity, threadCount);
+    return server.run(unixPath, tcpPort);
+}
+
+// --serve-load [--unix path | --port n] [--games 1000,10000,100000] [--moves n] [--connections n] [--window n]
+int runServeLoadMode(int argc, char** argv) {
+    std::string unixPath = defaultServeSocketPath;
+    int tcpPort = 0;
+    std::vector<uint32_t> gameCounts = { 1000, 10000, 100000 };
+    uint64_t moveCount = 200000;
+    int connectionCount = 4;
+    int window = 64;
+    try {
+        for (int i = 2; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            if (flag == "--unix") unixPath = argv[i + 1];
+            else if (flag == "--port") tcpPort = std::stoi(argv[i + 1]);
+            else if (flag == "--moves") moveCount = std::stoull(argv[i + 1]);
+            else if (flag == "--connections") connectionCount = std::max(1, std::stoi(argv[i + 1]));
+            else if (flag == "--window") window = std::max(1, std::stoi(argv[i + 1]));
+            else if (flag == "--games") {
+                gameCounts.clear();
+                std::istringstream list(argv[i + 1]);
+                std::string count;
+                while (std::getline(list, count, ',')) gameCounts.push_back((uint32_t)std::max(1ul, std::stoul(count)));
+            }
+        }
+    }
+    catch (const std::exception&) {
+        std::cerr << "Usage: --serve-load [--unix path | --port n] [--games 1000,10000,100000] [--moves n]"
+            " [--connections n] [--window n]\n";
+        return 1;
+    }
+
+    for (uint32_t gameCount : gameCounts) {
+        int levelConnections = (int)std::min<uint32_t>(connectionCount, gameCount);
+        std::vector<std::unique_ptr<LineConnection>> connections;
+        for (int c = 0; c < levelConnections; ++c) {
+            int fd = connectToServer(unixPath, tcpPort);
+            if (fd < 0) {
+                std::cerr << "Cannot connect to " << (tcpPort ? "127.0.0.1:" + std::to_string(tcpPort) : unixPath) << "\n";
+                return 1;
+            }
+            connections.push_back(std::make_unique<LineConnection>(fd));
+        }
+
+        std::vector<ServeLoadResult> results(levelConnections);
+        std::vector<std::string> errors(levelConnections);
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> clients;
+        for (int c = 0; c < levelConnections; ++c) {
+            clients.emplace_back([&, c]() {
+                uint32_t games = gameCount / levelConnections + (uint32_t(c) < gameCount % levelConnections ? 1 : 0);
+                uint64_t moves = moveCount / levelConnections + (uint64_t(c) < moveCount % levelConnections ? 1 : 0);
+                try {
+                    runServeLoadConnection(*connections[c], games, moves, window, gameCount + c, results[c]);
+                }
+                catch (const std::exception& e) {
+                    errors[c] = e.what();
+                }
+            });
+        }
+        for (std::thread& client : clients) {
+            client.join();
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        for (const std::string& error : errors) {
+            if (!error.empty()) {
+                std::cerr << error << "\n";
+                return 1;
+            }
+        }
+
+        // Asked while this level's games are still open; they are freed when the connections close.
+        connections[0]->send("stats\n");
+        std::string stats = connections[0]->readLine();
+        std::string bytesPerGame = "?";
+        size_t field = stats.find("bytes/game=");
+        if (field != std::string::npos) bytesPerGame = stats.substr(field + 11, stats.find(' ', field) - field - 11);
+
+        ServeLoadResult total;
+        for (ServeLoadResult& result : results) {
+            total.moves += result.moves;
+            total.restarts += result.restarts;
+            total.rejected += result.rejected;
+            total.latencies.insert(total.latencies.end(), result.latencies.begin(), result.latencies.end());
+        }
+        std::sort(total.latencies.begin(), total.latencies.end());
+        auto percentile = [&](double p) {
+            return total.latencies.empty() ? 0.0 : total.latencies[std::min(total.latencies.size() - 1, size_t(p * total.latencies.size()))];
+        };
+        std::cout << "games=" << gameCount << " moves=" << total.moves << " rejected=" << total.rejected
+            << " restarts=" << total.restarts << " connections=" << levelConnections << " window=" << window
+            << " seconds=" << seconds << " moves/sec=" << total.moves / seconds
+            << " p50_us=" << percentile(0.5) << " p99_us=" << percentile(0.99)
+            << " bytes/game=" << bytesPerGame << std::endl;
+    }
+    return 0;
+}
+#endif
+
+void runFrame(Board& chessBoard, const FrameInput& input, std::vector<std::pair<int, int>>& validMoves,
+    int& selectedX, int& selectedY, bool& pieceSelected) {
+    bool showCheck = false;
+    updateAnimation(input.deltaTime);
+
+    PieceColor currentTurn = chessBoard.isTurnValid(PieceColor::white) ? PieceColor::white : PieceColor::black;
+
+    if (chessBoard.isThreefoldRepetition()) {
+        beginFrame();
+        ClearBackground(BLACK);
+        DrawText("Draw by threefold repetition!", 100, 100, 20, BLUE);
+        endFrame();
+        return;
+    }
+    if (chessBoard.isFiftyMoveRuleDraw()) {
+        beginFrame();
+        ClearBackground(BLACK);
+        DrawText("Draw by fifty-move rule!", 100, 100, 20, BLUE);
+        endFrame();
+        return;
+    }
+
+    if (chessBoard.isKingInCheckmate(currentTurn)) {
+        beginFrame();
+        ClearBackground(BLACK);
+        DrawText("Checkmate! Game Over.", 100, 100, 20, RED);
+        endFrame();
+        return;
+    }
+    else if (chessBoard.isStalemate(currentTurn)) {
+        beginFrame();
+        ClearBackground(BLACK);
+        DrawText("Stalemate! Game Draw.", 100, 100, 20, YELLOW);
+        endFrame();
+        return;
+    }
+    else {
+        if (chessBoard.isPromotionPending()) {
+            PieceColor promotionColor = chessBoard.getPromotionColor();
+            beginFrame();
+            ClearBackground(BLACK);
+            drawBoard(chessBoard, validMoves, selectedX, selectedY, pieceSelected);
+            drawPromotionUI(promotionColor);
+            endFrame();
+
+            PieceType choice = handlePromotionInput(promotionColor, input);
+            if (choice != none) {
+                chessBoard.promotePawn(chessBoard.getPromotionX(), chessBoard.getPromotionY(), choice, promotionColor);
+                applyPremove(chessBoard);
+            }
+            return;
+        }
+
+        handlePlayerInput(chessBoard, currentTurn, input, validMoves, selectedX, selectedY, pieceSelected);
+        // Read after input so a move committed this frame is reflected right away.
+        showCheck = chessBoard.isKingInCheck(chessBoard.getCurrentTurn());
+    }
+
+    beginFrame();
+    ClearBackground(BLACK);
+    drawBoard(chessBoard, validMoves, selectedX, selectedY, pieceSelected);
+    if (showCheck) {
+        DrawText("Check!", 100, 100, 20, ORANGE);
+    }
+    endFrame();
+}
+
+// Prints frame-time percentiles and a hash of the final position for --replay-bench.
+void reportReplayBenchmark(std::vector<double> frameTimes, const Board& board) {
+    if (frameTimes.empty()) return;
+    std::sort(frameTimes.begin(), frameTimes.end());
+    auto percentile = [&](double p) { return frameTimes[std::min(frameTimes.size() - 1, size_t(p * frameTimes.size()))]; };
+    double total = 0.0;
+    for (double t : frameTimes) total += t;
+
+    std::cout << "frames=" << frameTimes.size() << " total_ms=" << total << " mean_ms=" << total / frameTimes.size()
+        << " p50_ms=" << percentile(0.50) << " p90_ms=" << percentile(0.90) << " p99_ms=" << percentile(0.99)
+        << " max_ms=" << frameTimes.back() << "\n"
+        << "final_state_hash=" << std::hex << board.getPositionHash() << std::dec << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+        return runBenchMode(argc, argv);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--annotate") {
+        return runAnnotateMode(argc, argv);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--diagrams") {
+        return runDiagramMode(argc, argv);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--archive-encode") {
+        return runArchiveEncodeMode(argc, argv);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--archive-decode") {
+        return runArchiveDecodeMode(argc, argv);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--archive-game") {
+        return runArchiveGameMode(argc, argv);
+    }
+    if (argc > 3 && std::string(argv[1]) == "--index-build") {
+        return runIndexBuildMode(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--index-query") {
+        return runIndexQueryMode(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve-bench") {
+        return runServeBenchMode(argc, argv);
+    }
+#ifdef __linux__
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        return runServeMode(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--serve-load") {
+        return runServeLoadMode(argc, argv);
+    }
+#endif
+    if (argc > 3 && std::string(argv[1]) == "--mate") {
+        return runMateMode(argc, argv);
+    }
+    if (argc > 2 && std::string(argv[1]) == "--export-atlas") {
+        Image atlas = loadPieceAtlasImage();
+        bool exported = ExportImageAsCode(atlas, argv[2]);
+        UnloadImage(atlas);
+        return exported ? 0 : 1;
+    }
+
+    // --record file | --replay file | --replay-bench file
+    std::string recordPath, replayPath;
+    bool replayBenchmark = false;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--record") recordPath = argv[i + 1];
+        else if (flag == "--replay") replayPath = argv[i + 1];
+        else if (flag == "--replay-bench") {
+            replayPath = argv[i + 1];
+            replayBenchmark = true;
+        }
+    }
+
+    std::vector<FrameInput> replayFrames;
+    size_t replayFrame = 0;
+    if (!replayPath.empty()) {
+        replayFrames = loadInputRecording(replayPath);
+    }
+    std::ofstream recording;
+    if (!recordPath.empty()) {
+        recording.open(recordPath);
+        recording.precision(9);
+    }
+
+    const int screenWidth = 640 + 2 * 20;
+    const int screenHeight = 640 + 2 * 20;
+
+    if (replayBenchmark) {
+        SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    }
+    InitWindow(screenWidth, screenHeight, "Chess Game");
+    if (replayBenchmark) {
+        offscreenTarget = LoadRenderTexture(screenWidth, screenHeight);
+        renderOffscreen = true;
+    }
+
+    Board chessBoard;
+    loadTextures();
+
+    bool pieceSelected = false;
+    int selectedX = -1, selectedY = -1;
+    std::vector<std::pair<int, int>> validMoves;
+
+    // loadFen also records the starting position, so repetition and the replay hash start from it.
+    chessBoard.loadFen(startingPositionFen);
+
+    // Benchmark replays run uncapped; recorded deltas drive the animations instead.
+    if (!replayBenchmark) {
+        SetTargetFPS(60);
+    }
+
+    std::vector<double> frameTimes;
+    bool firstFrame = true;
+    while (!WindowShouldClose()) {
+        FrameInput input;
+        if (!replayPath.empty()) {
+            if (replayFrame >= replayFrames.size()) break;
+            input = replayFrames[replayFrame++];
+        }
+        else {
+            input = pollFrameInput();
+        }
+        if (recording.is_open()) {
+            writeFrameInput(recording, input);
+        }
+
+        auto frameStart = std::chrono::steady_clock::now();
+        runFrame(chessBoard, input, validMoves, selectedX, selectedY, pieceSelected);
+        if (replayBenchmark) {
+            frameTimes.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        }
+
+        if (firstFrame) {
+            firstFrame = false;
+            double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStartTime).count();
+            TraceLog(LOG_INFO, "Startup: %.1f ms from process start to first frame", startupMs);
+        }
+    }
+
+    if (replayBenchmark) {
+        reportReplayBenchmark(frameTimes, chessBoard);
+        UnloadRenderTexture(offscreenTarget);
     }
 
     unloadTextures();